@@ -1,72 +1,79 @@
-#include <wx/vector.h>
-#include <regex>
-#include <wx/string.h>
-#include <fstream>
-#include <streambuf>
-#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <climits>
+#include <cctype>
 #include <map>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include "mappedfile.h"
+#include "symbols.h"
 #include "filereader.h"
 
-const std::map<wxString, long> FileReader::defines = {
-  {"WAVE_SINE", 0},
-  {"WAVE_SAWTOOTH", 1},
-  {"WAVE_TRIANGLE", 2},
-  {"WAVE_SQUARE_25", 3},
-  {"WAVE_SQUARE_50", 4},
-  {"WAVE_SQUARE_75", 5},
-  {"WAVE_FUZZY_SINE1", 6},
-  {"WAVE_FUZZY_SINE2", 7},
-  {"WAVE_FUZZY_SINE3", 8},
-  {"WAVE_FILTERED_SQUARE", 9},
-
-  {"WSIN", 0},
-  {"WSAW", 1},
-  {"WTRI", 2},
-  {"WS25", 3},
-  {"WS50", 4},
-  {"WS75", 5},
-  {"WFS1", 6},
-  {"WFS2", 7},
-  {"WFS3", 8},
-  {"WFSQ", 9},
-
-  {"PC_ENV_SPEED", 0},
-  {"PC_NOISE_PARAMS", 1},
-  {"PC_WAVE", 2},
-  {"PC_NOTE_UP", 3},
-  {"PC_NOTE_DOWN", 4},
-  {"PC_NOTE_CUT", 5},
-  {"PC_NOTE_HOLD", 6},
-  {"PC_ENV_VOL", 7},
-  {"PC_PITCH", 8},
-  {"PC_TREMOLO_LEVEL", 9},
-  {"PC_TREMOLO_RATE", 10},
-  {"PC_SLIDE", 11},
-  {"PC_SLIDE_SPEED", 12},
-  {"PC_LOOP_START", 13},
-  {"PC_LOOP_END", 14},
-  {"PATCH_END", 15},
-};
-
-const std::regex FileReader::multiline_comments("/\\*(.|[\r\n])*?\\*/");
-const std::regex FileReader::singleline_comments("//.*");
-const std::regex FileReader::white_space("[\t\n\r]");
-const std::regex FileReader::extra_space(" +");
-const std::regex FileReader::patch_declaration(
-    "const char ([a-zA-Z_][a-zA-Z_\\d]*)\\[\\] PROGMEM ?= ?");
-const std::regex FileReader::struct_declaration(
-    "const struct PatchStruct ([a-zA-Z_][a-zA-Z_\\d]*)\\[\\] PROGMEM ?= ?");
-
-long FileReader::string_to_long(const wxString &str) {
-  if (defines.find(str) != defines.end())
-    return defines.find(str)->second;
-  return strtol(str.c_str(), NULL, 0);
+const std::string_view FileReader::patch_declaration = "const char ";
+const std::string_view FileReader::struct_declaration =
+  "const struct PatchStruct ";
+
+long FileReader::string_to_long(std::string_view str) {
+  long value;
+  if (find_symbol(str, value))
+    return value;
+
+  /* Same as strtol(str, NULL, 0), but without needing a terminator */
+  const char *p = str.data(), *end = p + str.size();
+  while (p != end && isspace((unsigned char) *p))
+    p++;
+
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  int base = 10;
+  if (p != end && *p == '0') {
+    base = 8;
+    if (end-p > 2 && (p[1] == 'x' || p[1] == 'X')
+        && isxdigit((unsigned char) p[2])) {
+      base = 16;
+      p += 2;
+    }
+  }
+
+  unsigned long v = 0;
+  auto result = std::from_chars(p, end, v, base);
+  if (result.ptr == p)
+    return 0;
+  else if (result.ec == std::errc::result_out_of_range)
+    return negative? LONG_MIN : LONG_MAX;
+  else if (negative)
+    return v > (unsigned long) LONG_MAX+1? LONG_MIN : (long) (0ul-v);
+  return v > (unsigned long) LONG_MAX? LONG_MAX : (long) v;
 }
 
-bool FileReader::read_patch_vals(const wxString &str, wxVector<long> &vals) {
+bool FileReader::read_patch_vals(const char *begin, const char *end,
+    std::vector<long> &vals) {
+  /* Values are split by commas, ignoring spaces and nested blocks. They are
+   * read in place unless something like that splits one of them */
   int depth = 0;
-  std::string vstr;
-  for (auto c : str) {
+  const char *item_start = nullptr, *item_end = nullptr;
+  std::string split_item;
+
+  auto add_item = [&] () {
+    if (!split_item.empty()) {
+      vals.push_back(string_to_long(split_item));
+      split_item.clear();
+    }
+    else if (item_start != item_end) {
+      vals.push_back(string_to_long(
+            std::string_view(item_start, item_end-item_start)));
+    }
+    item_start = item_end = nullptr;
+  };
+
+  vals.clear();
+  for (const char *p = begin; p != end; p++) {
+    char c = *p;
     if (c == '{') {
       depth++;
     }
@@ -78,28 +85,39 @@ bool FileReader::read_patch_vals(const wxString &str, wxVector<long> &vals) {
         break;
       }
     }
-    else if (c != ' ' && depth == 1) {
-      vstr += c;
+    else if (c == ',' && depth == 1) {
+      add_item();
     }
-  }
-
-  std::stringstream ss(vstr);
-  std::string item;
-  vals.clear();
-  while (std::getline(ss, item, ',')) {
-    if (!item.empty()) {
-      vals.push_back(string_to_long(item));
+    else if (c != ' ' && depth == 1) {
+      if (item_start == item_end) {
+        item_start = p;
+        item_end = p+1;
+      }
+      else if (item_end == p && split_item.empty()) {
+        item_end++;
+      }
+      else {
+        if (split_item.empty())
+          split_item.assign(item_start, item_end);
+        split_item += c;
+      }
     }
   }
+  add_item();
 
   return !vals.empty();
 }
 
-bool FileReader::read_struct_vals(const wxString &str,
-    wxVector<wxString> &vals) {
+bool FileReader::read_struct_vals(const char *begin, const char *end,
+    std::vector<std::string> &vals) {
+  /* Every closing brace inside the struct also ends a value. Empty values
+   * are kept, except for the one after the last separator */
   int depth = 0;
-  std::string vstr;
-  for (auto c : str) {
+  std::string item;
+
+  vals.clear();
+  for (const char *p = begin; p != end; p++) {
+    char c = *p;
     if (c == '{') {
       depth++;
     }
@@ -111,97 +129,175 @@ bool FileReader::read_struct_vals(const wxString &str,
         break;
       }
       else {
-        vstr += ',';
+        vals.push_back(item);
+        item.clear();
       }
     }
+    else if (c == ',' && depth == 2) {
+      vals.push_back(item);
+      item.clear();
+    }
     else if (c != ' ' && depth == 2) {
-      vstr += c;
+      item += c;
     }
   }
-
-  std::stringstream ss(vstr);
-  std::string item;
-  vals.clear();
-  while (std::getline(ss, item, ',')) {
+  if (!item.empty())
     vals.push_back(item);
-  }
 
   return !vals.empty();
 }
 
-std::string FileReader::clean_code(const std::string &code) {
-  std::string clean_code, t;
-
-  /* Remove comments and unecessary white space */
-  std::regex_replace(std::back_inserter(clean_code), code.begin(), code.end(),
-      multiline_comments, "");
-  clean_code.swap(t);
-  clean_code.clear();
-  std::regex_replace(std::back_inserter(clean_code), t.begin(), t.end(),
-      singleline_comments, "");
-  clean_code.swap(t);
-  clean_code.clear();
-  std::regex_replace(std::back_inserter(clean_code), t.begin(), t.end(),
-      white_space, " ");
-  clean_code.swap(t);
-  clean_code.clear();
-  std::regex_replace(std::back_inserter(clean_code), t.begin(), t.end(),
-      extra_space, " ");
+const char *FileReader::find_declaration(const char *begin, const char *end,
+    std::string_view type, std::string_view &name) {
+  auto is_name_start = [] (char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  };
+  auto is_name_char = [&] (char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+  };
+  auto skip = [&] (const char *p, std::string_view s) -> const char * {
+    if (p == nullptr || (size_t) (end-p) < s.size()
+        || !std::equal(s.begin(), s.end(), p))
+      return nullptr;
+    return p + s.size();
+  };
+
+  /* Matches "<type>NAME[] PROGMEM ?= ?" */
+  for (const char *p = begin;
+      (p = std::search(p, end, type.begin(), type.end())) != end; p++) {
+    const char *name_start = p + type.size(), *q = name_start;
+    if (q == end || !is_name_start(*q))
+      continue;
+    while (q != end && is_name_char(*q))
+      q++;
+    const char *name_end = q;
+
+    q = skip(skip(q, "[]"), " PROGMEM");
+    if (q == nullptr)
+      continue;
+    if (q != end && *q == ' ')
+      q++;
+    if (q == end || *q != '=')
+      continue;
+    if (++q != end && *q == ' ')
+      q++;
+
+    name = std::string_view(name_start, name_end-name_start);
+    return q;
+  }
+
+  return nullptr;
+}
+
+std::string FileReader::clean_code(const char *begin, const char *end) {
+  std::string clean_code;
+  clean_code.reserve(end - begin);
+
+  /* Remove comments and unecessary white space in a single pass. Block
+   * comments are stripped before line comments, so a "//" that only appears
+   * once a block comment is gone still starts a line comment, and a block
+   * comment inside a line comment may hide its line break. */
+  const char *no_closing = end;
+  bool pending_slash = false;
+  bool in_line_comment = false;
+  bool last_space = false;
+
+  auto emit = [&] (char c) {
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      if (!last_space)
+        clean_code += ' ';
+      last_space = true;
+    }
+    else {
+      clean_code += c;
+      last_space = false;
+    }
+  };
+
+  for (const char *p = begin; p != end; p++) {
+    if (*p == '/' && p+1 != end && p[1] == '*' && p+2 < no_closing) {
+      static const char closing[] = "*/";
+      const char *c = std::search(p+2, end, closing, closing+2);
+      if (c != end) {
+        p = c+1;
+        continue;
+      }
+      /* Unterminated, so no block comment can start from here on */
+      no_closing = p;
+    }
+
+    if (in_line_comment) {
+      if (*p == '\n' || *p == '\r') {
+        in_line_comment = false;
+        emit(*p);
+      }
+    }
+    else if (*p == '/') {
+      if (pending_slash)
+        in_line_comment = true;
+      pending_slash = !pending_slash;
+    }
+    else {
+      if (pending_slash) {
+        emit('/');
+        pending_slash = false;
+      }
+      emit(*p);
+    }
+  }
+
+  if (pending_slash)
+    emit('/');
 
   return clean_code;
 }
 
 bool FileReader::read_patches(const std::string &clean_src,
-    std::multimap<wxString, wxVector<long>> &data) {
-  std::smatch match;
-  auto search_start = clean_src.cbegin();
+    std::multimap<std::string, std::vector<long>> &data) {
+  const char *search_start = clean_src.data();
+  const char *end = clean_src.data() + clean_src.size();
+  std::string_view name;
 
   data.clear();
 
-  while (std::regex_search(search_start, clean_src.cend(),
-        match, patch_declaration)) {
-    search_start += match.position() + match.length();
-
-    wxVector<long> vals;
-    std::string varea(search_start, clean_src.cend());
-    if (!read_patch_vals(varea, vals))
+  while ((search_start = find_declaration(search_start, end,
+          patch_declaration, name))) {
+    std::vector<long> vals;
+    if (!read_patch_vals(search_start, end, vals))
       return false;
-    data.emplace(match[1].str(), vals);
+    data.emplace(std::string(name), std::move(vals));
   }
 
   return true;
 }
 
 bool FileReader::read_structs(const std::string &clean_src,
-    std::multimap<wxString, wxVector<wxString>> &data) {
-  std::smatch match;
-  auto search_start = clean_src.cbegin();
+    std::multimap<std::string, std::vector<std::string>> &data) {
+  const char *search_start = clean_src.data();
+  const char *end = clean_src.data() + clean_src.size();
+  std::string_view name;
 
   data.clear();
 
-  while (std::regex_search(search_start, clean_src.cend(),
-        match, struct_declaration)) {
-    search_start += match.position() + match.length();
-
-    wxVector<wxString> vals;
-    std::string varea(search_start, clean_src.cend());
-    if (!read_struct_vals(varea, vals))
+  while ((search_start = find_declaration(search_start, end,
+          struct_declaration, name))) {
+    std::vector<std::string> vals;
+    if (!read_struct_vals(search_start, end, vals))
       return false;
-    data.emplace(match[1].str(), vals);
+    data.emplace(std::string(name), std::move(vals));
   }
 
   return true;
 }
 
-bool FileReader::read_patches_and_structs(const wxString &fn,
-    std::multimap<wxString, wxVector<long>> &patches,
-    std::multimap<wxString, wxVector<wxString>> &structs) {
-  std::ifstream f(fn);
-  if (!f.is_open())
+bool FileReader::read_patches_and_structs(const std::string &fn,
+    std::multimap<std::string, std::vector<long>> &patches,
+    std::multimap<std::string, std::vector<std::string>> &structs) {
+  MappedFile src;
+  if (!src.open(fn))
     return false;
-  std::string src((std::istreambuf_iterator<char>(f)),
-    std::istreambuf_iterator<char>());
-  std::string clean_src = clean_code(src);
+  std::string clean_src = clean_code(src.begin(), src.end());
+  src.close();
 
   return read_patches(clean_src, patches) && read_structs(clean_src, structs);
 }
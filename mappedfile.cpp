@@ -0,0 +1,179 @@
+#include <string>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+#include "mappedfile.h"
+
+#define READ_CHUNK_SIZE (1 << 16)
+
+MappedFile::MappedFile() :
+  data(nullptr),
+  size(0),
+  mapped(false)
+#ifdef _WIN32
+  , file(INVALID_HANDLE_VALUE),
+  mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+void MappedFile::close() {
+  if (mapped) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    munmap((void *) data, size);
+#endif
+    mapped = false;
+  }
+
+  buffer.clear();
+  buffer.shrink_to_fit();
+  data = nullptr;
+  size = 0;
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string &fn) {
+  close();
+
+  int length = MultiByteToWideChar(CP_UTF8, 0, fn.c_str(), -1, NULL, 0);
+  if (!length)
+    return false;
+  std::wstring wide_fn(length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, fn.c_str(), -1, &wide_fn[0], length);
+
+  file = CreateFileW(wide_fn.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER file_size;
+  if (GetFileType(file) != FILE_TYPE_DISK
+      || !GetFileSizeEx(file, &file_size)) {
+    /* Pipes and special files can't be mapped */
+    int fd = _open_osfhandle((intptr_t) file, _O_RDONLY);
+    if (fd == -1) {
+      CloseHandle(file);
+      file = INVALID_HANDLE_VALUE;
+      return false;
+    }
+    file = INVALID_HANDLE_VALUE;
+    bool ok = read_buffered(fd);
+    _close(fd);
+    return ok;
+  }
+
+  if (!file_size.QuadPart) {
+    CloseHandle(file);
+    file = INVALID_HANDLE_VALUE;
+    return true;
+  }
+
+  mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping != nullptr) {
+    data = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (data == nullptr) {
+    if (mapping != nullptr)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+    return false;
+  }
+
+  size = file_size.QuadPart;
+  mapped = true;
+
+  return true;
+}
+#else
+bool MappedFile::open(const std::string &fn) {
+  close();
+
+  int fd = ::open(fn.c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    return false;
+  }
+
+  /* Pipes and special files can't be mapped */
+  if (!S_ISREG(st.st_mode)) {
+    bool ok = read_buffered(fd);
+    ::close(fd);
+    return ok;
+  }
+
+  if (!st.st_size) {
+    ::close(fd);
+    return true;
+  }
+
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED) {
+    bool ok = read_buffered(fd);
+    ::close(fd);
+    return ok;
+  }
+  ::close(fd);
+
+  madvise(m, st.st_size, MADV_SEQUENTIAL);
+  data = (const char *) m;
+  size = st.st_size;
+  mapped = true;
+
+  return true;
+}
+#endif
+
+bool MappedFile::read_buffered(int fd) {
+  buffer.clear();
+
+  for (;;) {
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + READ_CHUNK_SIZE);
+#ifdef _WIN32
+    int r = _read(fd, &buffer[old_size], READ_CHUNK_SIZE);
+#else
+    ssize_t r = read(fd, &buffer[old_size], READ_CHUNK_SIZE);
+#endif
+    if (r < 0) {
+      /* Interrupted by a signal before anything was read */
+      if (errno == EINTR) {
+        buffer.resize(old_size);
+        continue;
+      }
+      buffer.clear();
+      return false;
+    }
+
+    buffer.resize(old_size + r);
+    if (!r)
+      break;
+  }
+
+  data = buffer.data();
+  size = buffer.size();
+
+  return true;
+}
@@ -0,0 +1,24 @@
+class MappedFile {
+  public:
+    MappedFile();
+    ~MappedFile();
+    /* UTF-8 on Windows, given to the system as is elsewhere */
+    bool open(const std::string &fn);
+    void close();
+    const char *begin() const { return data; }
+    const char *end() const { return data + size; }
+
+  private:
+    const char *data;
+    size_t size;
+    bool mapped;
+    std::string buffer;
+
+#ifdef _WIN32
+    /* HANDLEs, kept opaque so windows.h stays out of this header */
+    void *file;
+    void *mapping;
+#endif
+
+    bool read_buffered(int fd);
+};
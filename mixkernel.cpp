@@ -0,0 +1,111 @@
+#include <cstddef>
+#include <cstdint>
+#include "mixkernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define MIX_KERNEL_X86
+  #include <immintrin.h>
+#endif
+
+static void add_scalar(int16_t *sum, const uint8_t *frame, size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    sum[k] += frame[k] - 128;
+  }
+}
+
+static void clip_scalar(uint8_t *out, const int16_t *sum, size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    int16_t s = sum[k];
+    out[k] = (s < -128? -128 : s > 127? 127 : s) + 128;
+  }
+}
+
+#ifdef MIX_KERNEL_X86
+__attribute__((target("sse2")))
+static void add_sse2(int16_t *sum, const uint8_t *frame, size_t n) {
+  const __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi16(128);
+
+  size_t k = 0;
+  for (; k+16 <= n; k += 16) {
+    __m128i f = _mm_loadu_si128((const __m128i *) (frame + k));
+    __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(f, zero), bias);
+    __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(f, zero), bias);
+    __m128i *s = (__m128i *) (sum + k);
+    _mm_storeu_si128(s, _mm_add_epi16(_mm_loadu_si128(s), lo));
+    _mm_storeu_si128(s+1, _mm_add_epi16(_mm_loadu_si128(s+1), hi));
+  }
+
+  add_scalar(sum + k, frame + k, n - k);
+}
+
+/* Packing saturates to signed 8 bits, flipping the top bit adds 128 */
+__attribute__((target("sse2")))
+static void clip_sse2(uint8_t *out, const int16_t *sum, size_t n) {
+  const __m128i top = _mm_set1_epi8(-128);
+
+  size_t k = 0;
+  for (; k+16 <= n; k += 16) {
+    __m128i lo = _mm_loadu_si128((const __m128i *) (sum + k));
+    __m128i hi = _mm_loadu_si128((const __m128i *) (sum + k + 8));
+    _mm_storeu_si128((__m128i *) (out + k),
+        _mm_xor_si128(_mm_packs_epi16(lo, hi), top));
+  }
+
+  clip_scalar(out + k, sum + k, n - k);
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(int16_t *sum, const uint8_t *frame, size_t n) {
+  const __m256i bias = _mm256_set1_epi16(128);
+
+  size_t k = 0;
+  for (; k+16 <= n; k += 16) {
+    __m256i f = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128((const __m128i *) (frame + k)));
+    __m256i *s = (__m256i *) (sum + k);
+    _mm256_storeu_si256(s, _mm256_add_epi16(_mm256_loadu_si256(s),
+          _mm256_sub_epi16(f, bias)));
+  }
+
+  add_scalar(sum + k, frame + k, n - k);
+}
+
+/* Packing works per 128 bit lane, so the middle quarters get swapped back */
+__attribute__((target("avx2")))
+static void clip_avx2(uint8_t *out, const int16_t *sum, size_t n) {
+  const __m256i top = _mm256_set1_epi8(-128);
+
+  size_t k = 0;
+  for (; k+32 <= n; k += 32) {
+    __m256i lo = _mm256_loadu_si256((const __m256i *) (sum + k));
+    __m256i hi = _mm256_loadu_si256((const __m256i *) (sum + k + 16));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi),
+        0xd8);
+    _mm256_storeu_si256((__m256i *) (out + k), _mm256_xor_si256(packed, top));
+  }
+
+  clip_scalar(out + k, sum + k, n - k);
+}
+#endif
+
+const MixKernel &scalar_mix_kernel() {
+  static const MixKernel kernel = {"scalar", add_scalar, clip_scalar};
+  return kernel;
+}
+
+const MixKernel &mix_kernel() {
+  static const MixKernel kernel = [] {
+#ifdef MIX_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return MixKernel{"avx2", add_avx2, clip_avx2};
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+      return MixKernel{"sse2", add_sse2, clip_sse2};
+    }
+#endif
+    return scalar_mix_kernel();
+  }();
+
+  return kernel;
+}
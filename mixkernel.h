@@ -0,0 +1,14 @@
+/* Channels are mixed the way the console does it: their samples, already
+ * scaled by volume, are added up and the sum is clipped to 8 bits. Both
+ * steps use the widest instructions the CPU supports */
+
+struct MixKernel {
+  const char *name;
+  /* sum[k] += frame[k] - 128 */
+  void (*add)(int16_t *sum, const uint8_t *frame, size_t n);
+  /* out[k] = clamp(sum[k], -128, 127) + 128 */
+  void (*clip)(uint8_t *out, const int16_t *sum, size_t n);
+};
+
+const MixKernel &mix_kernel();
+const MixKernel &scalar_mix_kernel();
@@ -0,0 +1,64 @@
+#include <wx/treectrl.h>
+#include <wx/hashmap.h>
+#include <unordered_map>
+#include "nameindex.h"
+
+void NameIndex::add(const wxString &name, const wxTreeItemId &item) {
+  items[name] = item;
+}
+
+void NameIndex::remove(const wxString &name) {
+  items.erase(name);
+
+  /* Let next_name reuse the suffix of a generated name. The base may end in
+   * digits itself, so every split leaving at least two digits for the
+   * suffix is tried */
+  size_t digits = 0;
+  while (digits < name.length()
+      && wxIsdigit(name[name.length()-digits-1])) {
+    digits++;
+  }
+
+  for (size_t n_digits = 2; n_digits <= digits
+      && n_digits < name.length(); n_digits++) {
+    wxString base = name.Left(name.length()-n_digits);
+    long n;
+    auto counter = counters.find(base);
+    if (counter != counters.end() && name.Right(n_digits).ToLong(&n)
+        && wxString::Format(wxT("%s%02ld"), base, n) == name
+        && n < counter->second) {
+      counter->second = n;
+    }
+  }
+}
+
+void NameIndex::clear() {
+  items.clear();
+  counters.clear();
+}
+
+wxTreeItemId NameIndex::find(const wxString &name) const {
+  auto item = items.find(name);
+  if (item == items.end()) {
+    return wxTreeItemId();
+  }
+
+  return item->second;
+}
+
+wxString NameIndex::next_name(const wxString &base, bool try_bare) {
+  if (try_bare && items.find(base) == items.end()) {
+    return base;
+  }
+
+  long &counter = counters[base];
+  wxString next;
+  for (;; counter++) {
+    next = wxString::Format(wxT("%s%02ld"), base, counter);
+    if (items.find(next) == items.end()) {
+      break;
+    }
+  }
+
+  return next;
+}
@@ -0,0 +1,14 @@
+class NameIndex {
+  public:
+    void add(const wxString &name, const wxTreeItemId &item);
+    void remove(const wxString &name);
+    void clear();
+    wxTreeItemId find(const wxString &name) const;
+    wxString next_name(const wxString &base, bool try_bare=false);
+
+  private:
+    std::unordered_map<wxString, wxTreeItemId, wxStringHash, wxStringEqual>
+      items;
+    /* Lowest suffix that may still be free, per base name */
+    std::unordered_map<wxString, long, wxStringHash, wxStringEqual> counters;
+};
@@ -0,0 +1,99 @@
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "noisetable.h"
+
+/* Renders are split in blocks that never take more steps than this, so
+ * their states can be read past the end of the period */
+#define NOISE_TABLE_EXTRA 512
+
+const NoiseTable &NoiseTable::get(bool long_mode) {
+  static const NoiseTable tables[2] = {NoiseTable(false), NoiseTable(true)};
+  return tables[long_mode];
+}
+
+NoiseTable::NoiseTable(bool long_mode) {
+  /* Steps until a state repeats, which is where the period starts */
+  std::vector<int32_t> seen(1<<16, -1);
+  std::vector<uint16_t> states;
+  uint16_t barrel = 0x0101;
+  while (seen[barrel] == -1) {
+    seen[barrel] = states.size();
+    states.push_back(barrel);
+
+    uint8_t r_xor = (barrel ^ (barrel >> 1)) & 1;
+    barrel = (barrel >> 1) | (r_xor << (long_mode? 14 : 6));
+  }
+
+  lead_in = seen[barrel];
+  period = states.size() - lead_in;
+
+  bits.resize(states.size() + NOISE_TABLE_EXTRA);
+  for (size_t k = 0; k < bits.size(); k++) {
+    size_t s = k < states.size()? k : lead_in + (k - lead_in) % period;
+    bits[k] = states[s] & 1? 0xff : 0;
+  }
+}
+
+/* Same as stepping the LFSR whenever the divider runs out, once per sample */
+void NoiseTable::render(uint8_t *out, size_t n, size_t &pos,
+    int8_t &divider, uint8_t params, uint8_t vol) const {
+  for (size_t done = 0; done < n; done += NOISE_TABLE_EXTRA) {
+    render_block(out + done, std::min(n - done, (size_t) NOISE_TABLE_EXTRA),
+        pos, divider, params, vol);
+  }
+}
+
+void NoiseTable::render_block(uint8_t *out, size_t n, size_t &pos,
+    int8_t &divider, uint8_t params, uint8_t vol) const {
+  /* Only two levels are possible, 8 bytes are written at a time */
+  const uint64_t ones = 0x0101010101010101ull;
+  int8_t low = (int16_t) (-128*vol) / 256;
+  int8_t high = (int16_t) (127*vol) / 256;
+  uint8_t level = low + 128;
+  uint8_t diff = (uint8_t) (high + 128) ^ level;
+  size_t run = (params >> 1) + 1;
+
+  /* Samples before the next step keep the current state */
+  size_t j = std::min((size_t) divider, n);
+  memset(out, level ^ (bits[pos] & diff), j);
+  divider -= j;
+
+  /* The states of the following steps are next to each other */
+  const uint8_t *b = &bits[pos+1];
+  size_t steps = 0;
+  if (run == 1) {
+    uint64_t levels = level*ones, diffs = diff*ones;
+    for (steps = 0; j+8 <= n; j += 8, steps += 8) {
+      uint64_t w;
+      memcpy(&w, b + steps, 8);
+      w = levels ^ (w & diffs);
+      memcpy(out + j, &w, 8);
+    }
+    for (; j < n; j++, steps++) {
+      out[j] = level ^ (b[steps] & diff);
+    }
+  }
+  else {
+    while (j < n) {
+      uint8_t v = level ^ (b[steps++] & diff);
+      size_t len = std::min(run, n-j);
+      if (len <= 8 && j+8 <= n) {
+        /* Whatever goes beyond the run is written again by the next */
+        uint64_t w = v*ones;
+        memcpy(out + j, &w, 8);
+      }
+      else {
+        memset(out + j, v, len);
+      }
+      j += len;
+      divider = run - len;
+    }
+  }
+
+  pos += steps;
+  if (pos >= lead_in + period) {
+    pos = lead_in + (pos - lead_in) % period;
+  }
+}
@@ -0,0 +1,20 @@
+/* Output of the noise LFSR, which always starts at 0x0101, for the 7 and 15
+ * bit modes. After a short lead-in the sequence repeats, so the LFSR state
+ * is just a position in the table */
+class NoiseTable {
+  public:
+    static const NoiseTable &get(bool long_mode);
+    void render(uint8_t *out, size_t n, size_t &pos, int8_t &divider,
+        uint8_t params, uint8_t vol) const;
+
+  private:
+    NoiseTable(bool long_mode);
+    void render_block(uint8_t *out, size_t n, size_t &pos, int8_t &divider,
+        uint8_t params, uint8_t vol) const;
+
+    /* 0xff for the LFSR states with the low bit set, 0 otherwise. The
+     * period is repeated past its end, so a block can be read at once */
+    std::vector<uint8_t> bits;
+    size_t lead_in;
+    size_t period;
+};
@@ -0,0 +1,104 @@
+#include <wx/treectrl.h>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include "patchcache.h"
+
+PatchCache::Sound::~Sound() {
+  if (chunk != nullptr) {
+    Mix_FreeChunk(chunk);
+  }
+}
+
+PatchCache::PatchCache(size_t limit) : limit(limit), used(0) {
+}
+
+/* FNV-1a over the values */
+uint64_t PatchCache::hash(const wxVector<long> &data) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (long v : data) {
+    for (size_t k = 0; k < sizeof(v); k++) {
+      h = (h ^ (((unsigned long) v >> (k*8)) & 0xff)) * 0x100000001b3ull;
+    }
+  }
+
+  return h;
+}
+
+std::shared_ptr<const PatchCache::Sound> PatchCache::find(
+    const wxVector<long> &data) {
+  auto found = index.find(hash(data));
+  if (found == index.end()) {
+    return nullptr;
+  }
+
+  auto it = found->second;
+  auto &cached = it->second.data;
+  if (cached.size() != data.size()
+      || !std::equal(cached.begin(), cached.end(), data.begin())) {
+    return nullptr;
+  }
+
+  entries.splice(entries.begin(), entries, it);
+  return it->second.sound;
+}
+
+/* Loads the chunk if the sound doesn't have one yet. If the commands were
+ * rendered already, the sound that's there is kept */
+std::shared_ptr<const PatchCache::Sound> PatchCache::add(
+    const wxVector<long> &data, std::shared_ptr<Sound> sound) {
+  auto cached = find(data);
+  if (cached != nullptr) {
+    return cached;
+  }
+
+  if (sound->chunk == nullptr
+      && !(sound->chunk = Mix_QuickLoad_WAV(&(sound->wave[0])))) {
+    return nullptr;
+  }
+
+  /* Another patch with the same hash gives way */
+  uint64_t h = hash(data);
+  auto found = index.find(h);
+  if (found != index.end()) {
+    used -= found->second->second.sound->wave.size();
+    entries.erase(found->second);
+    index.erase(found);
+  }
+
+  entries.emplace_front(h, Entry{data, sound});
+  index[h] = entries.begin();
+  used += sound->wave.size();
+  trim();
+
+  return sound;
+}
+
+void PatchCache::set_limit(size_t bytes) {
+  limit = bytes;
+  trim();
+}
+
+void PatchCache::clear() {
+  entries.clear();
+  index.clear();
+  used = 0;
+}
+
+/* Sounds still being played are kept alive by their patches, dropping them
+ * here only means they'll be rendered again next time. The newest one is
+ * always kept, even if it's over the limit on its own */
+void PatchCache::trim() {
+  while (used > limit && entries.size() > 1) {
+    auto &last = entries.back();
+    used -= last.second.sound->wave.size();
+    index.erase(last.first);
+    entries.pop_back();
+  }
+}
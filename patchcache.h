@@ -0,0 +1,38 @@
+/* Rendered patches by the commands they were rendered from, so playing a
+ * patch again or a copy of it doesn't render anything. The least recently
+ * used ones are dropped once they take more than the limit */
+class PatchCache {
+  public:
+    struct Sound {
+      std::vector<uint8_t> wave;
+      /* Reads from wave */
+      Mix_Chunk *chunk;
+
+      ~Sound();
+    };
+
+    PatchCache(size_t limit);
+    std::shared_ptr<const Sound> find(const wxVector<long> &data);
+    std::shared_ptr<const Sound> add(const wxVector<long> &data,
+        std::shared_ptr<Sound> sound);
+    void set_limit(size_t bytes);
+    size_t get_limit() const { return limit; }
+    size_t get_used() const { return used; }
+    void clear();
+
+  private:
+    struct Entry {
+      wxVector<long> data;
+      std::shared_ptr<const Sound> sound;
+    };
+    typedef std::list<std::pair<uint64_t, Entry>> Entries;
+
+    /* Most recently used first */
+    Entries entries;
+    std::unordered_map<uint64_t, Entries::iterator> index;
+    size_t limit;
+    size_t used;
+
+    static uint64_t hash(const wxVector<long> &data);
+    void trim();
+};
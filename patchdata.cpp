@@ -1,416 +1,215 @@
 #include <wx/treectrl.h>
 #include <SDL.h>
 #include <SDL_mixer.h>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <utility>
+#include <cstdint>
+#include "patchprogram.h"
+#include "patchdefs.h"
+#include "patchcache.h"
 #include "patchdata.h"
-#include "waves.h"
-#include "step_table.h"
-
-PatchData::PatchData() : wave(nullptr), channel(-1) {
+#include "mixkernel.h"
+#include "patchplayer.h"
+
+/* Fewest frames between checkpoints, to keep them from piling up on patches
+ * with many short commands */
+#define CHECKPOINT_SPACING 15
+
+PatchData::PatchData() :
+  compiled(false),
+  rendered_noise(false),
+  channel(-1),
+  voice(0) {
 };
 
+/* Keeps the last render, so a copy rendered elsewhere only renders what
+ * changed since */
 PatchData::PatchData(const PatchData *p) :
   data(p->data),
-  wave(nullptr),
-  channel(-1) {
+  compiled(false),
+  samples(p->samples),
+  rendered_data(p->rendered_data),
+  rendered_noise(p->rendered_noise),
+  checkpoints(p->checkpoints),
+  channel(-1),
+  voice(0) {
+}
+
+PatchData::PatchData(const wxVector<long> &vals) :
+  compiled(false),
+  rendered_noise(false),
+  channel(-1),
+  voice(0) {
+  data.resize((vals.size()+2)/3*3);
+  if (!vals.empty()) {
+    PatchProgram::read_values(&vals[0], vals.size(), &data[0]);
+  }
 }
 
 PatchData::~PatchData() {
   stop();
-  free_chunk();
 }
 
 void PatchData::stop() {
+  if (voice) {
+    PatchPlayer::get().stop(voice);
+    voice = 0;
+  }
   if (channel != -1) {
     Mix_HaltChannel(channel);
     channel = -1;
   }
 }
 
+/* Streamed by the player, so it starts without waiting for a render */
 bool PatchData::play(bool loop) {
   stop();
-  free_chunk();
 
-  if (generate_wave(wave_data)
-      && (wave = Mix_QuickLoad_WAV(&(wave_data[0])))) {
-    if (loop) {
-      channel = Mix_PlayChannel(-1, wave, -1);
-    }
-    else {
-      Mix_PlayChannel(-1, wave, 0);
-    }
-  }
-  else {
+  auto p = compile();
+  if (p == nullptr) {
     return false;
   }
 
+  unsigned long id = PatchPlayer::get().play(p, loop);
+  if (loop) {
+    voice = id;
+  }
+
   return true;
 }
 
+/* For when the player has no device, with a sound rendered beforehand */
+void PatchData::play_sound(std::shared_ptr<const PatchCache::Sound> s,
+    bool loop) {
+  stop();
+
+  sound = s;
+  if (loop) {
+    channel = Mix_PlayChannel(-1, sound->chunk, -1);
+  }
+  else {
+    Mix_PlayChannel(-1, sound->chunk, 0);
+  }
+}
+
 void PatchData::retrigger() {
+  if (voice) {
+    PatchPlayer::get().restart(voice);
+  }
   if (channel != -1) {
-    Mix_PlayChannel(channel, wave, -1);
+    Mix_PlayChannel(channel, sound->chunk, -1);
   }
 }
 
-void PatchData::free_chunk() {
-  if (wave != nullptr) {
-    Mix_FreeChunk(wave);
-    wave = nullptr;
+bool PatchData::generate_wave(std::vector<uint8_t> &out_data) {
+  auto p = compile();
+  if (p == nullptr) {
+    return false;
   }
-}
 
-void PatchData::add_headers(wxVector<uint8_t> &out_data) {
-  size_t data_size = out_data.size() - WAVE_HEADER_LEN;
-  const uint32_t subchunk2_size = data_size & 1? data_size+1 : data_size;
-  const uint32_t chunk_size = subchunk2_size + 36;
-  const uint32_t sample_rate = SAMPLE_RATE;
-  int pos = 0;
+  update_samples(p);
 
-  /* ChunkID */
-  out_data[pos++] = 'R';
-  out_data[pos++] = 'I';
-  out_data[pos++] = 'F';
-  out_data[pos++] = 'F';
-  /* ChunkSize */
-  out_data[pos++] = chunk_size & 0xff;
-  out_data[pos++] = (chunk_size>>8) & 0xff;
-  out_data[pos++] = (chunk_size>>16) & 0xff;
-  out_data[pos++] = (chunk_size>>24) & 0xff;
-  /* Format */
-  out_data[pos++] = 'W';
-  out_data[pos++] = 'A';
-  out_data[pos++] = 'V';
-  out_data[pos++] = 'E';
-  /* Subchunk1ID */
-  out_data[pos++] = 'f';
-  out_data[pos++] = 'm';
-  out_data[pos++] = 't';
-  out_data[pos++] = ' ';
-  /* Subchunk1Size*/
-  out_data[pos++] = 16;
-  out_data[pos++] = 0;
-  out_data[pos++] = 0;
-  out_data[pos++] = 0;
-  /* AudioFormat */
-  out_data[pos++] = 1;
-  out_data[pos++] = 0;
-  /* NumChannels */
-  out_data[pos++] = 1;
-  out_data[pos++] = 0;
-  /* SampleRate */
-  out_data[pos++] = sample_rate & 0xff;
-  out_data[pos++] = (sample_rate>>8) & 0xff;
-  out_data[pos++] = (sample_rate>>16) & 0xff;
-  out_data[pos++] = (sample_rate>>24) & 0xff;
-  /* ByteRate */
-  out_data[pos++] = sample_rate & 0xff;
-  out_data[pos++] = (sample_rate>>8) & 0xff;
-  out_data[pos++] = (sample_rate>>16) & 0xff;
-  out_data[pos++] = (sample_rate>>24) & 0xff;
-  /* BlockAlign */
-  out_data[pos++] = 1;
-  out_data[pos++] = 0;
-  /* BitsPerSample */
-  out_data[pos++] = 8;
-  out_data[pos++] = 0;
-  /* Subchunk2ID */
-  out_data[pos++] = 'd';
-  out_data[pos++] = 'a';
-  out_data[pos++] = 't';
-  out_data[pos++] = 'a';
-  /* Subchunk2Size */
-  out_data[pos++] = subchunk2_size & 0xff;
-  out_data[pos++] = (subchunk2_size>>8) & 0xff;
-  out_data[pos++] = (subchunk2_size>>16) & 0xff;
-  out_data[pos++] = (subchunk2_size>>24) & 0xff;
+  /* Sized once, with the padding byte if needed */
+  size_t length = samples.size();
+  out_data.resize(WAVE_HEADER_LEN + length + (length & 1));
+  std::copy(samples.begin(), samples.end(), &out_data[WAVE_HEADER_LEN]);
+  if (length & 1) {
+    out_data.back() = 0;
+  }
+  PatchProgram::write_wave_header(&out_data[0], length);
 
-  /* Padding */
-  if (out_data.size() & 1)
-    out_data.push_back(0);
+  return true;
 }
 
-bool PatchData::generate_wave(wxVector<uint8_t> &out_data) {
-  int8_t note = 80;
-  uint16_t next_sample = 0;
-  uint8_t note_volume = DEFAULT_VOLUME;
-  uint8_t envelope_volume = 0xff;
-  int8_t envelope_step = 0;
-  int wave = 0;
-  uint8_t tremolo_level = 0;
-  uint8_t tremolo_rate = 24;
-  uint8_t tremolo_pos = 0;
-  uint8_t loop_count = 0;
-  uint8_t slide_speed = 0x10;
-  int16_t slide_step = 0;
-  int8_t slide_note = 0;
-  bool sliding = false;
-  uint16_t track_step = 0;
-  uint16_t noise_barrel = 0x0101;
-  uint8_t noise_params = 1;
-  int8_t noise_divider = 0;
-  int extra_time = 0;
-  bool is_noise = is_noise_patch();
-  out_data.resize(WAVE_HEADER_LEN);
-
-
-  for (size_t i = 0; extra_time || i < data.size(); i += 3) {
-    for (int delay = extra_time? extra_time : data[i]; delay; delay--) {
-      int16_t e_vol = envelope_volume + envelope_step;
-      e_vol = std::max((int16_t) 0, std::min((int16_t) 0xff, e_vol));
-      envelope_volume = e_vol;
-
-      if (sliding) {
-        track_step += slide_step;
-        uint16_t t_step = step_table[(int) slide_note];
-
-        if ((slide_step > 0 && track_step >= t_step)
-            || (slide_step < 0 && track_step <= t_step)) {
-          track_step = t_step;
-          sliding = false;
-        }
-      }
-
-      uint16_t vol = note_volume;
-      if (note_volume && envelope_volume) {
-        vol = ((vol*envelope_volume)+0x100) >> 8;
-
-        /* Assumes the master volume is 0xff, no calculation needed */
-
-        if (tremolo_level > 0) {
-          uint8_t t = ((uint8_t *) waves[0])[tremolo_pos];
-          t -= 128;
-          uint16_t t_vol = (tremolo_level*t)+0x100;
-          t_vol >>= 8;
-          vol = ((vol*(0xff-t_vol)) + 0x100) >> 8;
-        }
-      }
-      else {
-        vol = 0;
-      }
-
-      tremolo_pos += tremolo_rate;
-
-      for (int j = 0; j < SAMPLES_PER_FRAME; j++) {
-        int8_t sample;
-        if (is_noise) {
-          if (--noise_divider < 0) {
-            noise_divider = noise_params >> 1;
-            uint8_t r_xor = (noise_barrel ^ (noise_barrel >> 1)) & 1;
-            noise_barrel = (noise_barrel >> 1)
-              | (r_xor << (noise_params & 1? 14 : 6));
-          }
-          sample = noise_barrel & 1? 127 : -128;
-        }
-        else {
-          sample = waves[wave][next_sample>>8];
-          next_sample += track_step;
-        }
-        int16_t v16 = (int16_t) sample * vol;
-        /* Signed extention */
-        int8_t v8 = v16 / 256;
-        out_data.push_back((int) v8 + 128);
-      }
-    }
+/* Takes back what a copy rendered on another thread, unless the patch was
+ * edited since. Only on the main thread, like every other change */
+void PatchData::take_render(PatchData &rendered) {
+  if (rendered.rendered_data.size() != data.size()
+      || !std::equal(data.begin(), data.end(),
+        rendered.rendered_data.begin())) {
+    return;
+  }
 
-    if (extra_time || data[i+1] == PATCH_END) {
-      if (!envelope_volume) {
-        break;
-      }
-      if (envelope_step < 0) {
-        extra_time = 1;
-      }
-      else if (!extra_time) {
-        extra_time = EXTRA_TIME;
-      }
-      else {
-        break;
-      }
+  samples = std::move(rendered.samples);
+  rendered_data = std::move(rendered.rendered_data);
+  rendered_noise = rendered.rendered_noise;
+  checkpoints = std::move(rendered.checkpoints);
+}
 
-      continue;
+void PatchData::update_samples(const PatchProgram *p) {
+  /* Any row can make it a noise patch, which changes every frame */
+  size_t row = 0;
+  if (p->is_noise() == rendered_noise) {
+    size_t rows = std::min(data.size(), rendered_data.size())/3;
+    while (row < rows && std::equal(data.begin() + row*3,
+          data.begin() + row*3 + 3, rendered_data.begin() + row*3)) {
+      row++;
     }
-    else if (data[i+1] == PC_NOTE_CUT) {
-      break;
+    if (row == rows && data.size() == rendered_data.size()) {
+      return;
     }
+  }
 
-    int current;
-    int target;
-    switch (data[i+1]) {
-      case PC_ENV_SPEED:
-        envelope_step = data[i+2];
-        if (data[i+2] < -128 || data[i+2] > 127) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid envelope speed"), i/3+1);
-          return false;
-        }
-        break;
-
-      case PC_NOISE_PARAMS:
-        noise_barrel = 0x0101;
-        noise_params = data[i+2];
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid noise parameter"), i/3+1);
-          return false;
-        }
-        break;
-
-      case PC_WAVE:
-        wave = data[i+2];
-        if (wave < 0 || wave >= NUM_WAVES) {
-          last_error = wxString::Format(_("Command %lu: Invalid wave"), i/3+1);
-          return false;
-        }
-        break;
-
-      case PC_NOTE_UP:
-        note += data[i+2];
-        if (note > 126 || note < 0) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid note reached"), i/3+1);
-          return false;
-        }
-        track_step = step_table[(int) note];
-        break;
-
-      case PC_NOTE_DOWN:
-        note -= data[i+2];
-        if (note > 126 || note < 0) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid note reached"), i/3+1);
-          return false;
-        }
-        track_step = step_table[(int) note];
-        break;
-
-      /* TODO */
-      case PC_NOTE_HOLD:
-        break;
-
-      case PC_ENV_VOL:
-        envelope_volume = data[i+2];
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid envelope volume"), i/3+1);
-          return false;
-        }
-        break;
-
-      case PC_PITCH:
-        note = data[i+2];
-        if (note > 126 || note < 0) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid note"), i/3+1);
-          return false;
-        }
-        track_step = step_table[(int) note];
-        sliding = false;
-        break;
-
-      case PC_TREMOLO_LEVEL:
-        tremolo_level = data[i+2];
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid tremolo level"), i/3+1);
-          return false;
-        }
-        break;
+  auto checkpoint = std::upper_bound(checkpoints.begin(), checkpoints.end(),
+      row, [] (size_t r, const PatchProgram::Cursor::Checkpoint &c) {
+        return r < c.command;
+      });
+
+  PatchProgram::Cursor cursor;
+  size_t frame = 0;
+  cursor.record(&checkpoints, CHECKPOINT_SPACING);
+  cursor.reuse_loops();
+  /* Rows that changed from the first one on leave nothing to reuse */
+  if (row && checkpoint != checkpoints.begin()) {
+    checkpoints.erase(checkpoint, checkpoints.end());
+    cursor.resume(checkpoints.back(), p);
+    frame = checkpoints.back().frame;
+  }
+  else {
+    checkpoints.clear();
+    cursor.start(p);
+  }
 
-      case PC_TREMOLO_RATE:
-        tremolo_rate = data[i+2];
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid tremolo rate"), i/3+1);
-          return false;
-        }
-        break;
+  samples.resize(p->get_length());
+  cursor.render(samples.data() + frame*SAMPLES_PER_FRAME,
+      p->get_frames() - frame);
+  rendered_data = data;
+  rendered_noise = p->is_noise();
+}
 
-      case PC_SLIDE:
-        current = step_table[(int) note];
-        slide_note = note + data[i+2];
-        if (slide_note > 126 || slide_note < 0) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid slide note"), i/3+1);
-          return false;
-        }
-        target = step_table[(int) slide_note];
-        slide_step = std::max(1, (target-current)/slide_speed);
-        track_step += slide_step;
-        break;
+const PatchProgram *PatchData::compile() {
+  if (compiled) {
+    return program.get_error() == PatchProgram::NO_ERROR? &program : nullptr;
+  }
 
-      case PC_SLIDE_SPEED:
-        slide_speed = data[i+2];
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid slide speed"), i/3+1);
-          return false;
-        }
-        break;
+  compiled = true;
+  if (program.compile(data.empty()? nullptr : &data[0], data.size())) {
+    last_error.Clear();
+    return &program;
+  }
 
-      case PC_LOOP_END:
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid loop end jump"), i/3+1);
-          return false;
-        }
-        else if (data[i+2] > (long) i/3) {
-          last_error = wxString::Format(
-              _("Command %lu: Loop end jump to negative command"), i/3+1);
-          return false;
-        }
-        if (!loop_count) {
-          break;
-        }
-        else {
-          size_t old_i = i;
-          loop_count--;
-          if (data[i+2] > 0) {
-            for (long to_return = data[i+2]+1; to_return--; i -= 3) {
-              if (data[i+1] == PC_LOOP_START) {
-                last_error = wxString::Format(_("Command %lu: Loop end jump "
-                      "to before a loop start causes infinite loop"),
-                    old_i/3+1);
-                return false;
-              }
-            }
-          }
-          else {
-            do {
-              i -= 3;
-            } while(i >= 3 && data[i+1] != PC_LOOP_START);
-            if (data[i+1] != PC_LOOP_START) {
-              last_error = wxString::Format(
-                  _("Command %lu: No previous loop start"), old_i/3+1);
-              return false;
-            }
-          }
-        }
-        break;
+  last_error = wxString::Format(_("Command %lu: %s"),
+      program.get_error_command()+1,
+      wxGetTranslation(PatchProgram::error_message(program.get_error())));
 
-      case PC_LOOP_START:
-        loop_count = data[i+2];
-        if (data[i+2] < 0 || data[i+2] > 255) {
-          last_error = wxString::Format(
-              _("Command %lu: Invalid loop count"), i/3+1);
-          return false;
-        }
-        break;
+  return nullptr;
+}
 
-      default:
-        break;
-    }
+bool PatchData::get_duration(double &seconds) {
+  auto p = compile();
+  if (p == nullptr) {
+    return false;
   }
 
-  add_headers(out_data);
-
+  seconds = (double) p->get_length()/SAMPLE_RATE;
   return true;
 }
 
-bool PatchData::is_noise_patch() {
-  for (size_t i = 0; i < data.size(); i += 3) {
-    if (data[i+1] == PC_NOISE_PARAMS) {
-      return true;
-    }
-  }
-
-  return false;
+void PatchData::invalidate() {
+  compiled = false;
 }
@@ -0,0 +1,201 @@
+#include <wx/treectrl.h>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include "patchprogram.h"
+#include "patchdefs.h"
+#include "patchcache.h"
+#include "patchdata.h"
+#include "mixkernel.h"
+#include "patchplayer.h"
+
+/* Samples the device asks for at a time, about 32ms */
+#define PLAYER_BUFFER_SIZE 512
+
+const PatchPlayer::Layout PatchPlayer::default_layout = {3, true, true};
+
+PatchPlayer &PatchPlayer::get() {
+  static PatchPlayer player;
+  return player;
+}
+
+PatchPlayer::PatchPlayer() :
+  device(0),
+  last_id(0),
+  master_volume(0xff),
+  kernel(mix_kernel()),
+  mixed_pos(SAMPLES_PER_FRAME) {
+}
+
+bool PatchPlayer::open(const Layout &layout) {
+  close();
+
+  channels.clear();
+  auto add_channels = [&] (Type type, int count) {
+    for (int i = 0; i < count; i++) {
+      auto c = std::make_unique<Channel>();
+      c->type = type;
+      c->id = 0;
+      c->loop = false;
+      channels.push_back(std::move(c));
+    }
+  };
+  add_channels(WAVE, layout.wave_channels);
+  add_channels(NOISE, layout.noise_channel);
+  add_channels(PCM, layout.pcm_channel);
+
+  /* Anything the hardware wants differently is converted by SDL */
+  SDL_AudioSpec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.freq = SAMPLE_RATE;
+  spec.format = AUDIO_U8;
+  spec.channels = 1;
+  spec.samples = PLAYER_BUFFER_SIZE;
+  spec.callback = callback;
+  spec.userdata = this;
+  mixed_pos = SAMPLES_PER_FRAME;
+  device = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
+  if (!device) {
+    return false;
+  }
+
+  SDL_PauseAudioDevice(device, 0);
+  return true;
+}
+
+void PatchPlayer::close() {
+  if (device) {
+    /* The callback is done once this returns */
+    SDL_CloseAudioDevice(device);
+    device = 0;
+  }
+  stop_all();
+}
+
+/* Like the console's volume, it scales every channel before mixing */
+void PatchPlayer::set_master_volume(uint8_t volume) {
+  std::lock_guard<std::mutex> lock(mutex);
+  master_volume = volume;
+}
+
+/* Noise only plays on the noise channel. Waves take a free wave channel,
+ * then the PCM one, and otherwise the one that has been playing longest */
+PatchPlayer::Channel *PatchPlayer::find_channel(bool noise) {
+  Channel *oldest = nullptr;
+  for (auto &c : channels) {
+    if (noise? c->type != NOISE : c->type == NOISE) {
+      continue;
+    }
+    if (!c->id) {
+      return c.get();
+    }
+    if (oldest == nullptr || c->id < oldest->id) {
+      oldest = c.get();
+    }
+  }
+
+  return oldest;
+}
+
+/* Returns an id for stopping it, or 0 when it can't be played. The patch
+ * starts on the next frame */
+unsigned long PatchPlayer::play(const PatchProgram *program, bool loop) {
+  if (!program->get_frames()) {
+    return 0;
+  }
+
+  /* Copied before locking, and the old program freed after unlocking */
+  PatchProgram copy(*program);
+  std::lock_guard<std::mutex> lock(mutex);
+  Channel *c = find_channel(program->is_noise());
+  if (c == nullptr) {
+    return 0;
+  }
+
+  std::swap(c->program, copy);
+  c->cursor.start(&c->program);
+  c->loop = loop;
+  c->id = ++last_id;
+
+  return c->id;
+}
+
+void PatchPlayer::stop(unsigned long id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &c : channels) {
+    if (c->id == id) {
+      c->id = 0;
+    }
+  }
+}
+
+void PatchPlayer::stop_all() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &c : channels) {
+    c->id = 0;
+  }
+}
+
+void PatchPlayer::restart(unsigned long id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &c : channels) {
+    if (c->id == id) {
+      c->cursor.start(&c->program);
+    }
+  }
+}
+
+void PatchPlayer::callback(void *udata, uint8_t *stream, int len) {
+  ((PatchPlayer *) udata)->mix(stream, len);
+}
+
+/* Runs on the audio thread. Frames are mixed whole, so every channel moves
+ * on at the same time, as on the console */
+void PatchPlayer::mix(uint8_t *stream, size_t len) {
+  std::lock_guard<std::mutex> lock(mutex);
+  while (len) {
+    if (mixed_pos == SAMPLES_PER_FRAME) {
+      mix_frame();
+      mixed_pos = 0;
+    }
+
+    size_t n = std::min(len, SAMPLES_PER_FRAME - mixed_pos);
+    memcpy(stream, mixed + mixed_pos, n);
+    mixed_pos += n;
+    stream += n;
+    len -= n;
+  }
+}
+
+void PatchPlayer::mix_frame() {
+  int16_t sum[SAMPLES_PER_FRAME] = {0};
+  for (auto &c : channels) {
+    if (!c->id) {
+      continue;
+    }
+
+    c->cursor.set_master_volume(master_volume);
+    if (!c->cursor.render(c->frame, 1)) {
+      if (c->loop) {
+        c->cursor.start(&c->program);
+        c->cursor.set_master_volume(master_volume);
+      }
+      if (!c->loop || !c->cursor.render(c->frame, 1)) {
+        c->id = 0;
+        continue;
+      }
+    }
+
+    kernel.add(sum, c->frame, SAMPLES_PER_FRAME);
+  }
+
+  kernel.clip(mixed, sum, SAMPLES_PER_FRAME);
+}
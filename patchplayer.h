@@ -0,0 +1,58 @@
+/* Plays patches on channels laid out like the console's: wave channels, a
+ * noise channel and a PCM channel, mixed a frame at a time on an audio
+ * device of its own. Each patch is rendered as it plays, so it starts right
+ * away however long it is */
+class PatchPlayer {
+  public:
+    struct Layout {
+      int wave_channels;
+      bool noise_channel;
+      /* Mixed like a wave channel. With no samples to play, it takes wave
+       * patches once the wave channels are busy */
+      bool pcm_channel;
+    };
+    static const Layout default_layout;
+
+    static PatchPlayer &get();
+    bool open(const Layout &layout=default_layout);
+    void close();
+    bool is_open() const { return device != 0; }
+    void set_master_volume(uint8_t volume);
+    unsigned long play(const PatchProgram *program, bool loop);
+    void stop(unsigned long id);
+    void stop_all();
+    void restart(unsigned long id);
+
+  private:
+    enum Type {
+      WAVE,
+      NOISE,
+      PCM,
+    };
+
+    struct Channel {
+      Type type;
+      /* What's playing, 0 for nothing */
+      unsigned long id;
+      bool loop;
+      /* A copy, so edits to the patch don't reach the audio thread */
+      PatchProgram program;
+      PatchProgram::Cursor cursor;
+      uint8_t frame[SAMPLES_PER_FRAME];
+    };
+
+    std::vector<std::unique_ptr<Channel>> channels;
+    SDL_AudioDeviceID device;
+    std::mutex mutex;
+    unsigned long last_id;
+    uint8_t master_volume;
+    const MixKernel &kernel;
+    uint8_t mixed[SAMPLES_PER_FRAME];
+    size_t mixed_pos;
+
+    PatchPlayer();
+    Channel *find_channel(bool noise);
+    static void callback(void *udata, uint8_t *stream, int len);
+    void mix(uint8_t *stream, size_t len);
+    void mix_frame();
+};
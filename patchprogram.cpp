@@ -0,0 +1,797 @@
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "patchprogram.h"
+#include "wavekernel.h"
+#include "noisetable.h"
+#include "patchdefs.h"
+#include "waves.h"
+#include "step_table.h"
+
+/* Anything that isn't a known command does nothing */
+#define PC_NOP 16
+
+PatchProgram::PatchProgram() :
+  frames(0),
+  noise(false),
+  error(NO_ERROR),
+  error_command(0) {
+}
+
+bool PatchProgram::fail(Error e, size_t command) {
+  error = e;
+  error_command = command;
+  commands.clear();
+  frames = 0;
+
+  return false;
+}
+
+/* Commands from the values in a file, where anything from PATCH_END up
+ * ends the patch and a missing value is 0. Writes the size rounded up to
+ * whole commands */
+size_t PatchProgram::read_values(const long *vals, size_t size,
+    long *commands) {
+  size_t n = (size+2)/3*3;
+  for (size_t i = 0; i < n; i += 3) {
+    /* Delay */
+    commands[i] = vals[i];
+    /* Command */
+    commands[i+1] = i+1 < size? std::min((long) PATCH_END, vals[i+1]) : 0;
+    /* Parameter. PATCH_END might not have one */
+    commands[i+2] = i+2 < size? vals[i+2] : 0;
+  }
+
+  return n;
+}
+
+/* In English, the editor translates them */
+const char *PatchProgram::error_message(Error error) {
+  static const char *const messages[] = {
+    "",
+    "Invalid delay",
+    "Invalid envelope speed",
+    "Invalid noise parameter",
+    "Invalid wave",
+    "Invalid note reached",
+    "Invalid envelope volume",
+    "Invalid note",
+    "Invalid tremolo level",
+    "Invalid tremolo rate",
+    "Invalid slide note",
+    "Invalid slide speed",
+    "Slide with a slide speed of zero",
+    "Invalid loop end jump",
+    "Loop end jump to negative command",
+    "Loop end jump to before a loop start causes infinite loop",
+    "No previous loop start",
+    "Invalid loop count",
+  };
+
+  return messages[error];
+}
+
+/* The WAVE_HEADER_LEN bytes before length unsigned 8 bit mono samples. The
+ * data chunk is padded to an even size, which is left to the caller */
+void PatchProgram::write_wave_header(uint8_t *out, size_t length) {
+  const uint32_t subchunk2_size = length & 1? length+1 : length;
+  const uint32_t chunk_size = subchunk2_size + 36;
+  const uint32_t sample_rate = SAMPLE_RATE;
+  int pos = 0;
+
+  /* ChunkID */
+  out[pos++] = 'R';
+  out[pos++] = 'I';
+  out[pos++] = 'F';
+  out[pos++] = 'F';
+  /* ChunkSize */
+  out[pos++] = chunk_size & 0xff;
+  out[pos++] = (chunk_size>>8) & 0xff;
+  out[pos++] = (chunk_size>>16) & 0xff;
+  out[pos++] = (chunk_size>>24) & 0xff;
+  /* Format */
+  out[pos++] = 'W';
+  out[pos++] = 'A';
+  out[pos++] = 'V';
+  out[pos++] = 'E';
+  /* Subchunk1ID */
+  out[pos++] = 'f';
+  out[pos++] = 'm';
+  out[pos++] = 't';
+  out[pos++] = ' ';
+  /* Subchunk1Size*/
+  out[pos++] = 16;
+  out[pos++] = 0;
+  out[pos++] = 0;
+  out[pos++] = 0;
+  /* AudioFormat */
+  out[pos++] = 1;
+  out[pos++] = 0;
+  /* NumChannels */
+  out[pos++] = 1;
+  out[pos++] = 0;
+  /* SampleRate */
+  out[pos++] = sample_rate & 0xff;
+  out[pos++] = (sample_rate>>8) & 0xff;
+  out[pos++] = (sample_rate>>16) & 0xff;
+  out[pos++] = (sample_rate>>24) & 0xff;
+  /* ByteRate */
+  out[pos++] = sample_rate & 0xff;
+  out[pos++] = (sample_rate>>8) & 0xff;
+  out[pos++] = (sample_rate>>16) & 0xff;
+  out[pos++] = (sample_rate>>24) & 0xff;
+  /* BlockAlign */
+  out[pos++] = 1;
+  out[pos++] = 0;
+  /* BitsPerSample */
+  out[pos++] = 8;
+  out[pos++] = 0;
+  /* Subchunk2ID */
+  out[pos++] = 'd';
+  out[pos++] = 'a';
+  out[pos++] = 't';
+  out[pos++] = 'a';
+  /* Subchunk2Size */
+  out[pos++] = subchunk2_size & 0xff;
+  out[pos++] = (subchunk2_size>>8) & 0xff;
+  out[pos++] = (subchunk2_size>>16) & 0xff;
+  out[pos++] = (subchunk2_size>>24) & 0xff;
+}
+
+bool PatchProgram::compile(const long *data, size_t size) {
+  size_t n = size/3;
+  commands.resize(n);
+  frames = 0;
+  noise = false;
+  error = NO_ERROR;
+  error_command = 0;
+
+  /* Loop starts before each command, to resolve loop ends */
+  std::vector<size_t> starts(n+1, 0);
+  std::vector<size_t> previous_start(n, SIZE_MAX);
+
+  for (size_t i = 0; i < n; i++) {
+    long command = data[i*3+1];
+    long param = data[i*3+2];
+    auto &c = commands[i];
+
+    c.delay = (int) data[i*3];
+    c.command = command >= 0 && command <= PATCH_END? command : PC_NOP;
+    c.value = param;
+    c.step = 0;
+
+    starts[i+1] = starts[i] + (command == PC_LOOP_START);
+    if (i) {
+      previous_start[i] = data[i*3-2] == PC_LOOP_START?
+        i-1 : previous_start[i-1];
+    }
+
+    switch (command) {
+      case PC_ENV_SPEED:
+        c.value = (int8_t) param;
+        break;
+
+      case PC_NOISE_PARAMS:
+        noise = true;
+        /* Fall through */
+      case PC_ENV_VOL:
+      case PC_TREMOLO_LEVEL:
+      case PC_TREMOLO_RATE:
+      case PC_SLIDE_SPEED:
+      case PC_LOOP_START:
+        c.value = (uint8_t) param;
+        break;
+
+      case PC_WAVE:
+        c.value = (int) param;
+        break;
+
+      /* Only matters modulo 256, since notes are 8 bit */
+      case PC_NOTE_UP:
+      case PC_NOTE_DOWN:
+      case PC_SLIDE:
+        c.value = (uint8_t) param;
+        break;
+
+      case PC_PITCH:
+        c.value = (int8_t) param;
+        if (c.value >= 0 && c.value <= 126) {
+          c.step = step_table[c.value];
+        }
+        break;
+
+      case PC_LOOP_END:
+        if (param > 0 && param <= (long) i) {
+          c.value = i - param;
+        }
+        else if (param == 0 && previous_start[i] != SIZE_MAX) {
+          c.value = previous_start[i] + 1;
+        }
+        else {
+          c.value = 0;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  /* Follow the commands as they will be played, since some errors depend on
+   * the notes reached and on which loops are taken. The envelope is followed
+   * too, as it decides how long the end of the patch lasts */
+  int8_t note = 80;
+  uint8_t loop_count = 0;
+  uint8_t slide_speed = 0x10;
+  uint8_t envelope_volume = 0xff;
+  int8_t envelope_step = 0;
+  for (size_t i = 0, next; i < n; i = next) {
+    long param = data[i*3+2];
+    next = i+1;
+
+    /* A negative delay would play for ever */
+    if ((int) data[i*3] < 0) {
+      return fail(INVALID_DELAY, i);
+    }
+
+    /* Constant steps saturate, so all the frames can be applied at once */
+    int delay = data[i*3];
+    frames += delay;
+    envelope_volume = std::max(0l, std::min(0xffl,
+          envelope_volume + (long) delay*envelope_step));
+
+    switch (data[i*3+1]) {
+      case PATCH_END:
+        if (envelope_volume && envelope_step < 0) {
+          /* Until the envelope fades out */
+          frames += (envelope_volume - envelope_step - 1)/-envelope_step;
+        }
+        else if (envelope_volume) {
+          frames += EXTRA_TIME;
+        }
+        return true;
+
+      case PC_NOTE_CUT:
+        return true;
+
+      case PC_ENV_SPEED:
+        envelope_step = param;
+        if (param < -128 || param > 127) {
+          return fail(INVALID_ENV_SPEED, i);
+        }
+        break;
+
+      case PC_NOISE_PARAMS:
+        if (param < 0 || param > 255) {
+          return fail(INVALID_NOISE_PARAMS, i);
+        }
+        break;
+
+      case PC_WAVE:
+        if ((int) param < 0 || (int) param >= NUM_WAVES) {
+          return fail(INVALID_WAVE, i);
+        }
+        break;
+
+      case PC_NOTE_UP:
+        note += param;
+        if (note > 126 || note < 0) {
+          return fail(INVALID_NOTE_REACHED, i);
+        }
+        break;
+
+      case PC_NOTE_DOWN:
+        note -= param;
+        if (note > 126 || note < 0) {
+          return fail(INVALID_NOTE_REACHED, i);
+        }
+        break;
+
+      case PC_ENV_VOL:
+        envelope_volume = param;
+        if (param < 0 || param > 255) {
+          return fail(INVALID_ENV_VOL, i);
+        }
+        break;
+
+      case PC_PITCH:
+        note = param;
+        if (note > 126 || note < 0) {
+          return fail(INVALID_NOTE, i);
+        }
+        break;
+
+      case PC_TREMOLO_LEVEL:
+        if (param < 0 || param > 255) {
+          return fail(INVALID_TREMOLO_LEVEL, i);
+        }
+        break;
+
+      case PC_TREMOLO_RATE:
+        if (param < 0 || param > 255) {
+          return fail(INVALID_TREMOLO_RATE, i);
+        }
+        break;
+
+      case PC_SLIDE: {
+        int8_t slide_note = note + param;
+        if (slide_note > 126 || slide_note < 0) {
+          return fail(INVALID_SLIDE_NOTE, i);
+        }
+        else if (!slide_speed) {
+          return fail(ZERO_SLIDE_SPEED, i);
+        }
+        break;
+      }
+
+      case PC_SLIDE_SPEED:
+        slide_speed = param;
+        if (param < 0 || param > 255) {
+          return fail(INVALID_SLIDE_SPEED, i);
+        }
+        break;
+
+      case PC_LOOP_END:
+        if (param < 0 || param > 255) {
+          return fail(INVALID_LOOP_END, i);
+        }
+        else if (param > (long) i) {
+          return fail(NEGATIVE_LOOP_END, i);
+        }
+        if (!loop_count) {
+          break;
+        }
+        loop_count--;
+        if (param > 0 && starts[i+1] != starts[i-param]) {
+          return fail(INFINITE_LOOP_END, i);
+        }
+        else if (param == 0 && previous_start[i] == SIZE_MAX) {
+          return fail(NO_LOOP_START, i);
+        }
+        next = commands[i].value;
+        break;
+
+      case PC_LOOP_START:
+        loop_count = param;
+        if (param < 0 || param > 255) {
+          return fail(INVALID_LOOP_COUNT, i);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return true;
+}
+
+size_t PatchProgram::get_length() const {
+  return frames*SAMPLES_PER_FRAME;
+}
+
+/* Everything the commands set that the frames depend on */
+struct FrameState {
+  uint8_t note_volume = DEFAULT_VOLUME;
+  uint8_t envelope_volume = 0xff;
+  int8_t envelope_step = 0;
+  int wave = 0;
+  uint8_t tremolo_level = 0;
+  uint8_t tremolo_rate = 24;
+  uint8_t tremolo_pos = 0;
+  uint16_t track_step = 0;
+  uint16_t next_sample = 0;
+  /* Steps of the noise LFSR since it was last reset to 0x0101 */
+  size_t noise_pos = 0;
+  uint8_t noise_params = 1;
+  int8_t noise_divider = 0;
+  uint8_t master_volume = 0xff;
+  const WaveKernel *kernel = &wave_kernel();
+  uint8_t table[WAVE_TABLE_SIZE] = {0};
+  int table_wave = -1;
+  int table_vol = -1;
+};
+
+template <bool ENVELOPE, bool TREMOLO>
+static inline uint8_t frame_volume(FrameState &s) {
+  if (ENVELOPE) {
+    int16_t e_vol = s.envelope_volume + s.envelope_step;
+    e_vol = std::max((int16_t) 0, std::min((int16_t) 0xff, e_vol));
+    s.envelope_volume = e_vol;
+  }
+
+  if (!s.note_volume || !s.envelope_volume) {
+    return 0;
+  }
+  uint16_t vol = ((s.note_volume*s.envelope_volume)+0x100) >> 8;
+
+  if (s.master_volume != 0xff) {
+    vol = ((vol*s.master_volume)+0x100) >> 8;
+  }
+
+  if (TREMOLO) {
+    uint8_t t = ((uint8_t *) waves[0])[s.tremolo_pos];
+    t -= 128;
+    uint16_t t_vol = (s.tremolo_level*t)+0x100;
+    t_vol >>= 8;
+    vol = ((vol*(0xff-t_vol)) + 0x100) >> 8;
+  }
+
+  return vol;
+}
+
+template <bool NOISE>
+static inline void render_samples(FrameState &s, uint8_t vol, uint8_t *out,
+    size_t n) {
+  if (NOISE) {
+    NoiseTable::get(s.noise_params & 1).render(out, n, s.noise_pos,
+        s.noise_divider, s.noise_params, vol);
+    return;
+  }
+
+  /* Volume and step are the same for the whole block */
+  if (s.wave != s.table_wave || vol != s.table_vol) {
+    s.kernel->scale(s.table, waves[s.wave], vol);
+    s.table_wave = s.wave;
+    s.table_vol = vol;
+  }
+  s.kernel->lookup(out, s.table, s.next_sample, s.track_step, n);
+  s.next_sample += n*s.track_step;
+}
+
+/* The frames between two commands, with only the features they use. When
+ * the volume holds still, they are rendered as a single block */
+template <bool NOISE, bool ENVELOPE, bool TREMOLO>
+static uint8_t *render_frames(FrameState &s, uint32_t count, uint8_t *out) {
+  if (!ENVELOPE && !TREMOLO) {
+    size_t n = (size_t) count*SAMPLES_PER_FRAME;
+    render_samples<NOISE>(s, frame_volume<false, false>(s), out, n);
+    s.tremolo_pos += count*s.tremolo_rate;
+    return out + n;
+  }
+
+  for (; count; count--) {
+    render_samples<NOISE>(s, frame_volume<ENVELOPE, TREMOLO>(s), out,
+        SAMPLES_PER_FRAME);
+    s.tremolo_pos += s.tremolo_rate;
+    out += SAMPLES_PER_FRAME;
+  }
+
+  return out;
+}
+
+template <bool NOISE>
+static uint8_t *render_run(FrameState &s, uint32_t count, uint8_t *out) {
+  if (!count) {
+    return out;
+  }
+
+  /* A saturated envelope doesn't change the volume either */
+  bool envelope = s.envelope_step < 0? s.envelope_volume > 0
+    : s.envelope_step > 0 && s.envelope_volume < 0xff;
+  bool tremolo = s.tremolo_level > 0;
+
+  if (envelope && tremolo) {
+    return render_frames<NOISE, true, true>(s, count, out);
+  }
+  else if (envelope) {
+    return render_frames<NOISE, true, false>(s, count, out);
+  }
+  else if (tremolo) {
+    return render_frames<NOISE, false, true>(s, count, out);
+  }
+  return render_frames<NOISE, false, false>(s, count, out);
+}
+
+/* Writes exactly get_length() samples */
+void PatchProgram::render(uint8_t *out) const {
+  Cursor cursor;
+  cursor.reuse_loops();
+  cursor.start(this);
+  cursor.render(out, frames);
+}
+
+/* Where a cursor stopped, so it can carry on from there */
+struct PatchProgram::Cursor::State {
+  FrameState frame;
+  uint8_t *(*run)(FrameState &s, uint32_t count, uint8_t *out);
+  size_t command;
+  /* Frames still to be rendered before the command runs */
+  uint32_t pending;
+  int extra_time;
+  int8_t note;
+  uint8_t loop_count;
+  uint8_t slide_speed;
+  bool done;
+  /* Frames since it started */
+  size_t rendered;
+  /* Commands reached so far, which are always the first ones */
+  size_t reached;
+};
+
+PatchProgram::Cursor::Cursor() :
+  program(nullptr),
+  state(new State),
+  checkpoints(nullptr),
+  checkpoint_spacing(0) {
+  state->done = true;
+}
+
+PatchProgram::Cursor::~Cursor() {
+}
+
+void PatchProgram::Cursor::start(const PatchProgram *p) {
+  State &s = *state;
+  program = p;
+  if (loop_entry != nullptr) {
+    loop_entry->done = true;
+  }
+  s.frame = FrameState();
+  s.run = p->noise? render_run<true> : render_run<false>;
+  s.command = 0;
+  s.extra_time = 0;
+  s.note = 80;
+  s.loop_count = 0;
+  s.slide_speed = 0x10;
+  s.done = false;
+  s.rendered = 0;
+  s.reached = 0;
+  enter();
+}
+
+/* Carries on with a program that only differs from the one the checkpoint
+ * was taken with from its command on */
+void PatchProgram::Cursor::resume(const Checkpoint &checkpoint,
+    const PatchProgram *p) {
+  program = p;
+  *state = *checkpoint.state;
+  if (loop_entry != nullptr) {
+    loop_entry->done = true;
+  }
+  enter();
+}
+
+/* Adds a checkpoint the first time each command is reached, as long as it's
+ * at least the given number of frames after the last one */
+void PatchProgram::Cursor::record(std::vector<Checkpoint> *checkpoints,
+    size_t spacing) {
+  this->checkpoints = checkpoints;
+  checkpoint_spacing = spacing;
+}
+
+bool PatchProgram::Cursor::is_done() const {
+  return state->done;
+}
+
+/* Applies from the next frame on, until the cursor starts over */
+void PatchProgram::Cursor::set_master_volume(uint8_t volume) {
+  state->frame.master_volume = volume;
+}
+
+/* Renders up to the given number of frames, fewer only once it's done */
+size_t PatchProgram::Cursor::render(uint8_t *out, size_t frames) {
+  State &s = *state;
+  size_t rendered = 0;
+  while (!s.done && rendered < frames) {
+    if (s.pending) {
+      uint32_t count = std::min((size_t) s.pending, frames - rendered);
+      out = s.run(s.frame, count, out);
+      s.pending -= count;
+      s.rendered += count;
+      rendered += count;
+    }
+    else {
+      size_t loop_end = advance();
+      if (loop_end != SIZE_MAX && loop_entry != nullptr) {
+        size_t repeated = repeat_loop(loop_end, out, frames - rendered);
+        out += repeated*SAMPLES_PER_FRAME;
+        rendered += repeated;
+      }
+    }
+  }
+
+  return rendered;
+}
+
+/* Output only depends on these, not on loop counters or what's cached. The
+ * tremolo position is left out when there's no tremolo to read it */
+static bool same_frames(const FrameState &a, const FrameState &b,
+    bool tremolo) {
+  return a.note_volume == b.note_volume
+    && a.envelope_volume == b.envelope_volume
+    && a.envelope_step == b.envelope_step
+    && a.wave == b.wave
+    && a.tremolo_level == b.tremolo_level
+    && a.tremolo_rate == b.tremolo_rate
+    && (!tremolo || a.tremolo_pos == b.tremolo_pos)
+    && a.track_step == b.track_step
+    && a.next_sample == b.next_sample
+    && a.noise_pos == b.noise_pos
+    && a.noise_params == b.noise_params
+    && a.noise_divider == b.noise_divider
+    && a.master_volume == b.master_volume;
+}
+
+/* Output is written right after the frames already rendered, which are
+ * still there, so repeated loop iterations can be copied from them */
+void PatchProgram::Cursor::reuse_loops() {
+  loop_entry.reset(new State);
+  loop_entry->done = true;
+}
+
+/* Called right after a loop jumped back. If it did so from the same state
+ * as the last time, every iteration left comes out like the last one did,
+ * as long as the loop has no other loop end inside. Returns the frames
+ * copied */
+size_t PatchProgram::Cursor::repeat_loop(size_t loop_end, uint8_t *out,
+    size_t frames) {
+  State &s = *state, &last = *loop_entry;
+  bool repeated = !last.done && last.command == s.command
+    && last.note == s.note && last.slide_speed == s.slide_speed;
+  bool tremolo = s.frame.tremolo_level > 0;
+  for (size_t i = s.command; repeated && i < loop_end; i++) {
+    auto command = program->commands[i].command;
+    repeated = command != PC_LOOP_END;
+    tremolo |= command == PC_TREMOLO_LEVEL;
+  }
+
+  size_t length = s.rendered - last.rendered;
+  size_t copies = s.loop_count + 1;
+  if (!repeated || !same_frames(last.frame, s.frame, tremolo)
+      || length*copies > frames) {
+    last = s;
+    last.done = false;
+    return 0;
+  }
+
+  size_t size = length*SAMPLES_PER_FRAME;
+  for (size_t k = 0; k < copies; k++) {
+    memcpy(out + k*size, out - size, size);
+  }
+  s.rendered += length*copies;
+  s.frame.tremolo_pos += (uint8_t) (s.frame.tremolo_pos
+      - last.frame.tremolo_pos)*copies;
+
+  /* Back at the loop end with nothing left to loop */
+  s.loop_count = 0;
+  s.command = loop_end + 1;
+  last.done = true;
+  enter();
+
+  return length*copies;
+}
+
+/* Sets up the frames before the current command. Commands are first reached
+ * in order, since loops only jump back */
+void PatchProgram::Cursor::enter() {
+  State &s = *state;
+  if (!s.extra_time && s.command == s.reached
+      && s.command < program->commands.size()) {
+    if (checkpoints != nullptr && (checkpoints->empty()
+          || (s.command > checkpoints->back().command
+            && s.rendered >= checkpoints->back().frame
+            + checkpoint_spacing))) {
+      checkpoints->push_back({s.command, s.rendered,
+          std::make_shared<const State>(s)});
+    }
+    s.reached++;
+  }
+
+  if (!s.extra_time && s.command >= program->commands.size()) {
+    s.done = true;
+  }
+  else {
+    s.pending = s.extra_time? s.extra_time
+      : program->commands[s.command].delay;
+  }
+}
+
+/* The player slides a little every frame, but here a slide only moves the
+ * step once when it starts. Returns the loop end it jumped back from, if it
+ * did */
+size_t PatchProgram::Cursor::advance() {
+  State &s = *state;
+  auto &commands = program->commands;
+  size_t i = s.command, next = i+1;
+
+  if (s.extra_time || commands[i].command == PATCH_END) {
+    if (!s.frame.envelope_volume) {
+      s.done = true;
+      return SIZE_MAX;
+    }
+    if (s.frame.envelope_step < 0) {
+      s.extra_time = 1;
+    }
+    else if (!s.extra_time) {
+      s.extra_time = EXTRA_TIME;
+    }
+    else {
+      s.done = true;
+      return SIZE_MAX;
+    }
+
+    s.command = next;
+    enter();
+    return SIZE_MAX;
+  }
+
+  auto &c = commands[i];
+  int current;
+  int target;
+  switch (c.command) {
+    case PC_NOTE_CUT:
+      s.done = true;
+      return SIZE_MAX;
+
+    case PC_ENV_SPEED:
+      s.frame.envelope_step = c.value;
+      break;
+
+    case PC_NOISE_PARAMS:
+      s.frame.noise_pos = 0;
+      s.frame.noise_params = c.value;
+      break;
+
+    case PC_WAVE:
+      s.frame.wave = c.value;
+      break;
+
+    case PC_NOTE_UP:
+      s.note += c.value;
+      s.frame.track_step = step_table[(int) s.note];
+      break;
+
+    case PC_NOTE_DOWN:
+      s.note -= c.value;
+      s.frame.track_step = step_table[(int) s.note];
+      break;
+
+    case PC_ENV_VOL:
+      s.frame.envelope_volume = c.value;
+      break;
+
+    case PC_PITCH:
+      s.note = c.value;
+      s.frame.track_step = c.step;
+      break;
+
+    case PC_TREMOLO_LEVEL:
+      s.frame.tremolo_level = c.value;
+      break;
+
+    case PC_TREMOLO_RATE:
+      s.frame.tremolo_rate = c.value;
+      break;
+
+    case PC_SLIDE:
+      current = step_table[(int) s.note];
+      target = step_table[(int) (int8_t) (s.note + c.value)];
+      s.frame.track_step += std::max(1, (target-current)/s.slide_speed);
+      break;
+
+    case PC_SLIDE_SPEED:
+      s.slide_speed = c.value;
+      break;
+
+    case PC_LOOP_END:
+      if (s.loop_count) {
+        s.loop_count--;
+        next = c.value;
+      }
+      break;
+
+    case PC_LOOP_START:
+      s.loop_count = c.value;
+      break;
+
+    default:
+      break;
+  }
+
+  s.command = next;
+  enter();
+
+  return next <= i? i : SIZE_MAX;
+}
@@ -0,0 +1,94 @@
+/* A patch checked and decoded once, so it can be rendered any number of
+ * times without validating anything again */
+class PatchProgram {
+  public:
+    enum Error {
+      NO_ERROR,
+      INVALID_DELAY,
+      INVALID_ENV_SPEED,
+      INVALID_NOISE_PARAMS,
+      INVALID_WAVE,
+      INVALID_NOTE_REACHED,
+      INVALID_ENV_VOL,
+      INVALID_NOTE,
+      INVALID_TREMOLO_LEVEL,
+      INVALID_TREMOLO_RATE,
+      INVALID_SLIDE_NOTE,
+      INVALID_SLIDE_SPEED,
+      ZERO_SLIDE_SPEED,
+      INVALID_LOOP_END,
+      NEGATIVE_LOOP_END,
+      INFINITE_LOOP_END,
+      NO_LOOP_START,
+      INVALID_LOOP_COUNT,
+    };
+
+    /* Renders a program a few frames at a time, carrying on from where it
+     * stopped. Nothing is allocated after it's constructed, unless it
+     * records checkpoints */
+    class Cursor {
+      private:
+        struct State;
+
+      public:
+        /* Where it was right before a command's delay */
+        struct Checkpoint {
+          size_t command;
+          size_t frame;
+          std::shared_ptr<const State> state;
+        };
+
+        Cursor();
+        ~Cursor();
+        void start(const PatchProgram *p);
+        void resume(const Checkpoint &checkpoint, const PatchProgram *p);
+        void record(std::vector<Checkpoint> *checkpoints, size_t spacing);
+        void reuse_loops();
+        size_t render(uint8_t *out, size_t frames);
+        bool is_done() const;
+        void set_master_volume(uint8_t volume);
+
+      private:
+        const PatchProgram *program;
+        std::unique_ptr<State> state;
+        std::vector<Checkpoint> *checkpoints;
+        size_t checkpoint_spacing;
+        /* Right after the last loop jump, done if there's none to compare */
+        std::unique_ptr<State> loop_entry;
+
+        void enter();
+        size_t advance();
+        size_t repeat_loop(size_t loop_end, uint8_t *out, size_t frames);
+    };
+
+    PatchProgram();
+    static size_t read_values(const long *vals, size_t size, long *commands);
+    static const char *error_message(Error error);
+    static void write_wave_header(uint8_t *out, size_t length);
+    bool compile(const long *data, size_t size);
+    void render(uint8_t *out) const;
+    size_t get_frames() const { return frames; }
+    size_t get_length() const;
+    Error get_error() const { return error; }
+    size_t get_error_command() const { return error_command; }
+    bool is_noise() const { return noise; }
+
+  private:
+    struct Command {
+      uint32_t delay;
+      /* Parameter already truncated the way the player does, or the
+       * command to resume at for loop ends */
+      int32_t value;
+      /* Step of the note set by PITCH */
+      uint16_t step;
+      uint8_t command;
+    };
+
+    std::vector<Command> commands;
+    size_t frames;
+    bool noise;
+    Error error;
+    size_t error_command;
+
+    bool fail(Error e, size_t command);
+};
@@ -0,0 +1,101 @@
+#include <wx/treectrl.h>
+#include <wx/hashmap.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include "structdata.h"
+#include "patchrefs.h"
+
+void PatchReferences::update(StructData *s) {
+  unlink(s);
+
+  auto &names = used[s];
+  for (size_t i = 2; i < s->data.size(); i += 5) {
+    auto &patch = s->data[i];
+    if (patch == wxT("NULL")) {
+      continue;
+    }
+
+    auto &rows = users[patch][s];
+    if (rows.empty()) {
+      names.push_back(patch);
+    }
+    rows.push_back(i/5);
+  }
+}
+
+void PatchReferences::remove(StructData *s) {
+  unlink(s);
+  used.erase(s);
+}
+
+void PatchReferences::clear() {
+  users.clear();
+  used.clear();
+}
+
+const PatchReferences::Users *PatchReferences::find(
+    const wxString &patch) const {
+  auto u = users.find(patch);
+  return u == users.end()? nullptr : &u->second;
+}
+
+const wxVector<wxString> &PatchReferences::patches(StructData *s) const {
+  static const wxVector<wxString> none;
+  auto names = used.find(s);
+  return names == used.end()? none : names->second;
+}
+
+void PatchReferences::rename(const wxString &src, const wxString &dst,
+    const std::unordered_set<StructData *> *only) {
+  auto u = users.find(src);
+  if (u == users.end() || src == dst) {
+    return;
+  }
+
+  wxVector<std::pair<StructData *, wxVector<size_t>>> renamed;
+  for (auto user = u->second.begin(); user != u->second.end();) {
+    if (only == nullptr || only->count(user->first)) {
+      renamed.emplace_back(user->first, std::move(user->second));
+      user = u->second.erase(user);
+    }
+    else {
+      user++;
+    }
+  }
+  if (u->second.empty()) {
+    users.erase(u);
+  }
+
+  for (auto &r : renamed) {
+    auto s = r.first;
+    for (auto row : r.second) {
+      s->data[row*5+2] = dst;
+    }
+
+    auto &names = used[s];
+    names.erase(std::find(names.begin(), names.end(), src));
+    auto &rows = users[dst][s];
+    if (rows.empty()) {
+      names.push_back(dst);
+    }
+    rows.insert(rows.end(), r.second.begin(), r.second.end());
+    std::sort(rows.begin(), rows.end());
+  }
+}
+
+void PatchReferences::unlink(StructData *s) {
+  auto names = used.find(s);
+  if (names == used.end()) {
+    return;
+  }
+
+  for (auto &patch : names->second) {
+    auto u = users.find(patch);
+    u->second.erase(s);
+    if (u->second.empty()) {
+      users.erase(u);
+    }
+  }
+  names->second.clear();
+}
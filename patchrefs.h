@@ -0,0 +1,21 @@
+/* Which struct rows use each patch, so renames and removals don't have to
+ * scan every struct */
+class PatchReferences {
+  public:
+    typedef std::unordered_map<StructData *, wxVector<size_t>> Users;
+
+    void update(StructData *s);
+    void remove(StructData *s);
+    void clear();
+    const Users *find(const wxString &patch) const;
+    const wxVector<wxString> &patches(StructData *s) const;
+    void rename(const wxString &src, const wxString &dst,
+        const std::unordered_set<StructData *> *only=nullptr);
+
+  private:
+    std::unordered_map<wxString, Users, wxStringHash, wxStringEqual> users;
+    /* Distinct patches each struct refers to */
+    std::unordered_map<StructData *, wxVector<wxString>> used;
+
+    void unlink(StructData *s);
+};
@@ -0,0 +1,273 @@
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+  #include <wx/wx.h>
+#endif
+#include <wx/grid.h>
+#include <wx/treectrl.h>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <algorithm>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "patchprogram.h"
+#include "patchdefs.h"
+#include "patchcache.h"
+#include "patchdata.h"
+#include "symbols.h"
+#include "rowops.h"
+#include "patchtable.h"
+
+const wxString PatchTable::command_choices[16] = {
+  _("ENV_SPEED"),
+  _("NOISE_PARAMS"),
+  _("WAVE"),
+  _("NOTE_UP"),
+  _("NOTE_DOWN"),
+  _("NOTE_CUT"),
+  _("NOTE_HOLD"),
+  _("ENV_VOL"),
+  _("PITCH"),
+  _("TREMOLO_LEVEL"),
+  _("TREMOLO_RATE"),
+  _("SLIDE"),
+  _("SLIDE_SPEED"),
+  _("LOOP_START"),
+  _("LOOP_END"),
+  _("PATCH_END"),
+};
+
+/* Indexed by command id */
+const std::pair<long, long> PatchTable::limits[16] = {
+  /* ENV_SPEED */ std::make_pair(-128, 127),
+  /* NOISE_PARAMS */ std::make_pair(0, 255),
+  /* WAVE */ std::make_pair(0, NUM_WAVES-1),
+  /* NOTE_UP */ std::make_pair(0, 255),
+  /* NOTE_DOWN */ std::make_pair(0, 255),
+  /* NOTE_CUT */ std::make_pair(0, 0),
+  /* NOTE_HOLD */ std::make_pair(0, 0),
+  /* ENV_VOL */ std::make_pair(0, 255),
+  /* PITCH */ std::make_pair(0, 126),
+  /* TREMOLO_LEVEL */ std::make_pair(0, 255),
+  /* TREMOLO_RATE */ std::make_pair(0, 255),
+  /* SLIDE */ std::make_pair(-128, 127),
+  /* SLIDE_SPEED */ std::make_pair(0, 255),
+  /* LOOP_START */ std::make_pair(0, 255),
+  /* LOOP_END */ std::make_pair(0, 255),
+  /* PATCH_END */ std::make_pair(0, 0),
+};
+
+PatchTable::PatchTable() : data(nullptr) {
+  valid_attr = new wxGridCellAttr();
+  valid_attr->SetBackgroundColour(wxColour(0, 127, 0));
+  invalid_attr = new wxGridCellAttr();
+  invalid_attr->SetBackgroundColour(wxColor(127, 0, 0));
+
+  /* Command color is always green */
+  command_attr = valid_attr->Clone();
+  command_attr->SetEditor(new wxGridCellChoiceEditor(16, command_choices,
+        false));
+}
+
+PatchTable::~PatchTable() {
+  valid_attr->DecRef();
+  invalid_attr->DecRef();
+  command_attr->DecRef();
+}
+
+void PatchTable::set_data(PatchData *d) {
+  int old_rows = GetNumberRows();
+  data = d;
+  int rows = GetNumberRows();
+
+  if (rows < old_rows) {
+    notify(wxGRIDTABLE_NOTIFY_ROWS_DELETED, rows, old_rows-rows);
+  }
+  else if (rows > old_rows) {
+    notify(wxGRIDTABLE_NOTIFY_ROWS_APPENDED, rows-old_rows, 0);
+  }
+}
+
+wxArrayInt PatchTable::move_rows(const wxArrayInt &rows, bool up) {
+  data->invalidate();
+  return move_vector_rows(data->data, 3, rows, up);
+}
+
+void PatchTable::clone_rows(const wxArrayInt &rows) {
+  data->invalidate();
+  clone_vector_rows(data->data, 3, rows);
+  notify(wxGRIDTABLE_NOTIFY_ROWS_APPENDED, rows.GetCount(), 0);
+}
+
+void PatchTable::delete_rows(const wxArrayInt &rows) {
+  data->invalidate();
+  delete_vector_rows(data->data, 3, rows);
+
+  /* Contiguous runs are reported from the bottom up */
+  for (int j = rows.GetCount()-1; j >= 0;) {
+    int i = j;
+    while (i > 0 && rows[i-1] == rows[i]-1) {
+      i--;
+    }
+    notify(wxGRIDTABLE_NOTIFY_ROWS_DELETED, rows[i], j-i+1);
+    j = i-1;
+  }
+}
+
+int PatchTable::GetNumberRows() {
+  return data == nullptr? 0 : data->data.size()/3;
+}
+
+int PatchTable::GetNumberCols() {
+  return 3;
+}
+
+wxString PatchTable::GetValue(int row, int col) {
+  if (col == 1) {
+    return command_choices[std::min(15l, data->data[row*3+1])];
+  }
+
+  return wxString::Format(wxT("%ld"), GetValueAsLong(row, col));
+}
+
+void PatchTable::SetValue(int row, int col, const wxString &value) {
+  if (col == 1) {
+    SetValueAsLong(row, col, command_id(value));
+  }
+  else {
+    SetValueAsLong(row, col, strtol(value.c_str(), NULL, 0));
+  }
+}
+
+bool PatchTable::CanGetValueAs(int row, int col, const wxString &type_name) {
+  (void) row;
+  return type_name == wxGRID_VALUE_STRING
+    || (type_name == wxGRID_VALUE_NUMBER && col != 1);
+}
+
+bool PatchTable::CanSetValueAs(int row, int col, const wxString &type_name) {
+  return CanGetValueAs(row, col, type_name);
+}
+
+long PatchTable::GetValueAsLong(int row, int col) {
+  return data->data[row*3+col];
+}
+
+void PatchTable::SetValueAsLong(int row, int col, long value) {
+  data->data[row*3+col] = value;
+  data->invalidate();
+}
+
+bool PatchTable::InsertRows(size_t pos, size_t num) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  /* New commands are "0, ENV_SPEED, 0" */
+  data->invalidate();
+  auto &d = data->data;
+  size_t old_size = d.size();
+  d.resize(old_size + num*3, 0);
+  std::move_backward(d.begin() + pos*3, d.begin() + old_size, d.end());
+  std::fill(d.begin() + pos*3, d.begin() + (pos+num)*3, 0);
+
+  notify(wxGRIDTABLE_NOTIFY_ROWS_INSERTED, pos, num);
+
+  return true;
+}
+
+bool PatchTable::AppendRows(size_t num) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  data->invalidate();
+  data->data.resize(data->data.size() + num*3, 0);
+  notify(wxGRIDTABLE_NOTIFY_ROWS_APPENDED, num, 0);
+
+  return true;
+}
+
+bool PatchTable::DeleteRows(size_t pos, size_t num) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  data->invalidate();
+  auto &d = data->data;
+  d.erase(d.begin() + pos*3, d.begin() + (pos+num)*3);
+  notify(wxGRIDTABLE_NOTIFY_ROWS_DELETED, pos, num);
+
+  return true;
+}
+
+wxString PatchTable::GetColLabelValue(int col) {
+  static const wxString labels[3] = {
+    _("Delay"),
+    _("Command"),
+    _("Parameter"),
+  };
+
+  return labels[col];
+}
+
+wxGridCellAttr *PatchTable::GetAttr(int row, int col,
+    wxGridCellAttr::wxAttrKind kind) {
+  (void) kind;
+  wxGridCellAttr *attr = valid_attr;
+
+  if (data == nullptr || row >= GetNumberRows()) {
+    attr = valid_attr;
+  }
+  else if (col == 0) {
+    /* Delay color, always an unsigned integer */
+    long delay = data->data[row*3];
+    attr = delay < 0 || delay > 255? invalid_attr : valid_attr;
+  }
+  else if (col == 1) {
+    attr = command_attr;
+  }
+  else {
+    /* Param limit depends on the command */
+    auto &limit = limits[std::min(15l, data->data[row*3+1])];
+    long param = data->data[row*3+2];
+    attr = param < limit.first || param > limit.second?
+      invalid_attr : valid_attr;
+  }
+
+  attr->IncRef();
+  return attr;
+}
+
+long PatchTable::command_id(const wxString &label) {
+  /* Command names are short and ASCII, so they fit on the stack */
+  char name[32];
+  size_t len = 0;
+  long id;
+
+  for (auto c : label) {
+    if (len == sizeof(name) || !c.IsAscii()) {
+      return PATCH_END;
+    }
+    name[len++] = (char) c;
+  }
+
+  if (!find_symbol("PC_", std::string_view(name, len), id)) {
+    return PATCH_END;
+  }
+
+  return id;
+}
+
+void PatchTable::notify(int message, int pos, int num) {
+  if (GetView() == nullptr) {
+    return;
+  }
+
+  wxGridTableMessage msg(this, message, pos, num);
+  GetView()->ProcessTableMessage(msg);
+}
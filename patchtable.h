@@ -0,0 +1,40 @@
+/* Grid model that reads and writes a PatchData's commands in place */
+class PatchTable : public wxGridTableBase {
+  public:
+    PatchTable();
+    virtual ~PatchTable();
+    void set_data(PatchData *d);
+    PatchData *get_data() const { return data; }
+    wxArrayInt move_rows(const wxArrayInt &rows, bool up);
+    void clone_rows(const wxArrayInt &rows);
+    void delete_rows(const wxArrayInt &rows);
+
+    virtual int GetNumberRows();
+    virtual int GetNumberCols();
+    virtual wxString GetValue(int row, int col);
+    virtual void SetValue(int row, int col, const wxString &value);
+    virtual bool CanGetValueAs(int row, int col, const wxString &type_name);
+    virtual bool CanSetValueAs(int row, int col, const wxString &type_name);
+    virtual long GetValueAsLong(int row, int col);
+    virtual void SetValueAsLong(int row, int col, long value);
+    virtual bool InsertRows(size_t pos=0, size_t num=1);
+    virtual bool AppendRows(size_t num=1);
+    virtual bool DeleteRows(size_t pos=0, size_t num=1);
+    virtual wxString GetColLabelValue(int col);
+    virtual wxGridCellAttr *GetAttr(int row, int col,
+        wxGridCellAttr::wxAttrKind kind);
+
+    static long command_id(const wxString &label);
+
+    static const wxString command_choices[16];
+
+  private:
+    PatchData *data;
+    wxGridCellAttr *valid_attr;
+    wxGridCellAttr *invalid_attr;
+    wxGridCellAttr *command_attr;
+
+    void notify(int message, int pos, int num);
+
+    static const std::pair<long, long> limits[16];
+};
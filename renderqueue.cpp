@@ -0,0 +1,141 @@
+#include <wx/treectrl.h>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "threadpool.h"
+#include "patchprogram.h"
+#include "patchdefs.h"
+#include "patchcache.h"
+#include "patchdata.h"
+#include "renderqueue.h"
+
+struct RenderQueue::Job {
+  /* The patch it's for, null if it can't be replaced */
+  PatchData *key;
+  /* A copy with the patch's last render, so the patch can be edited while
+   * it renders */
+  PatchData patch;
+  std::vector<Callback> callbacks;
+  std::shared_ptr<PatchCache::Sound> sound;
+  /* Only set on the main thread, with the mutex held */
+  bool cancelled;
+
+  Job(PatchData *p, bool replaceable) :
+    key(replaceable? p : nullptr),
+    patch(p),
+    cancelled(false) {
+  }
+};
+
+RenderQueue::RenderQueue(wxEvtHandler *handler, size_t threads) :
+  handler(handler),
+  stopping(false),
+  pool(threads) {
+}
+
+/* Jobs left in the pool are skipped, and those already rendering aren't
+ * handed back */
+RenderQueue::~RenderQueue() {
+  std::lock_guard<std::mutex> lock(mutex);
+  stopping = true;
+}
+
+/* Exports aren't replaceable, so they're written even if the patch is
+ * edited before they're done */
+void RenderQueue::render(PatchData *patch, Callback done,
+    bool replaceable) {
+  if (replaceable) {
+    auto found = jobs.find(patch);
+    if (found != jobs.end()) {
+      auto &data = found->second->patch.data;
+      if (data.size() == patch->data.size()
+          && std::equal(data.begin(), data.end(), patch->data.begin())) {
+        found->second->callbacks.push_back(std::move(done));
+        return;
+      }
+      cancel(patch);
+    }
+  }
+
+  auto job = std::make_shared<Job>(patch, replaceable);
+  job->callbacks.push_back(std::move(done));
+  if (replaceable) {
+    jobs[patch] = job;
+  }
+
+  pool.push([this, job] { run(job); });
+}
+
+void RenderQueue::cancel(const PatchData *patch) {
+  auto found = jobs.find(patch);
+  if (found == jobs.end()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    found->second->cancelled = true;
+  }
+  jobs.erase(found);
+}
+
+/* Exports carry on, they don't point to any patch */
+void RenderQueue::cancel_all() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &job : jobs) {
+      job.second->cancelled = true;
+    }
+  }
+  jobs.clear();
+}
+
+/* Runs on a worker thread */
+void RenderQueue::run(std::shared_ptr<Job> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping || job->cancelled) {
+      return;
+    }
+  }
+
+  auto sound = std::make_shared<PatchCache::Sound>();
+  sound->chunk = nullptr;
+  if (job->patch.generate_wave(sound->wave)) {
+    job->sound = sound;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!stopping && !job->cancelled) {
+    handler->CallAfter([this, job] { finish(job); });
+  }
+}
+
+void RenderQueue::finish(std::shared_ptr<Job> job) {
+  if (job->cancelled) {
+    return;
+  }
+
+  /* Replacing a job cancels it, so this one is still the patch's. Exports
+   * may outlive theirs, so they keep nothing */
+  if (job->key != nullptr) {
+    jobs.erase(job->key);
+    job->key->take_render(job->patch);
+  }
+
+  /* They may queue more */
+  auto callbacks = std::move(job->callbacks);
+  for (auto &done : callbacks) {
+    done(job->patch, job->sound);
+  }
+}
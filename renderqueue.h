@@ -0,0 +1,36 @@
+class PatchData;
+
+/* Renders patches on worker threads and hands the sounds back on the main
+ * thread. A patch has one job at a time: asking again with the same
+ * commands waits for the same render, and with other ones drops the old
+ * job, which an edit made stale */
+class RenderQueue {
+  public:
+    /* Called on the main thread with the copy that was rendered, and no
+     * sound if it failed. The patch has taken back its render by then */
+    typedef std::function<void(const PatchData &rendered,
+        std::shared_ptr<PatchCache::Sound> sound)> Callback;
+
+    /* Zero threads means one per core */
+    RenderQueue(wxEvtHandler *handler, size_t threads=0);
+    ~RenderQueue();
+    void render(PatchData *patch, Callback done, bool replaceable=true);
+    void cancel(const PatchData *patch);
+    void cancel_all();
+
+  private:
+    struct Job;
+
+    wxEvtHandler *handler;
+    /* Jobs that can still be replaced, by the patch they're for. Only used
+     * on the main thread */
+    std::unordered_map<const PatchData *, std::shared_ptr<Job>> jobs;
+    /* Held while cancelling, and by the workers while they check for it */
+    std::mutex mutex;
+    bool stopping;
+    /* Last, so the workers are gone before anything else is */
+    ThreadPool pool;
+
+    void run(std::shared_ptr<Job> job);
+    void finish(std::shared_ptr<Job> job);
+};
@@ -0,0 +1,76 @@
+/* Block operations on vectors holding rows of a fixed width. Row numbers
+ * are always sorted in ascending order */
+
+/* Moves all the rows one position up or down at once. Runs of rows already
+ * packed against the top or bottom stay. Returns where each row ended */
+template <class T>
+wxArrayInt move_vector_rows(wxVector<T> &data, size_t width,
+    const wxArrayInt &rows, bool up) {
+  int n_rows = data.size()/width;
+  int count = rows.GetCount();
+  wxArrayInt moved;
+  moved.Add(0, count);
+
+  for (int i = 0; i < count;) {
+    int j = i;
+    while (j+1 < count && rows[j+1] == rows[j]+1) {
+      j++;
+    }
+    int first = rows[i], last = rows[j];
+
+    int offset = 0;
+    if (up && first != i) {
+      /* The row above the run goes below it */
+      std::rotate(data.begin() + (first-1)*width, data.begin() + first*width,
+          data.begin() + (last+1)*width);
+      offset = -1;
+    }
+    else if (!up && last != n_rows-count+j) {
+      /* The row below the run goes above it */
+      std::rotate(data.begin() + first*width, data.begin() + (last+1)*width,
+          data.begin() + (last+2)*width);
+      offset = 1;
+    }
+
+    for (int k = i; k <= j; k++) {
+      moved[k] = rows[k] + offset;
+    }
+    i = j+1;
+  }
+
+  return moved;
+}
+
+/* Appends copies of the rows to the end */
+template <class T>
+void clone_vector_rows(wxVector<T> &data, size_t width,
+    const wxArrayInt &rows) {
+  data.reserve(data.size() + rows.GetCount()*width);
+  for (auto row : rows) {
+    for (size_t j = 0; j < width; j++) {
+      data.push_back(data[row*width+j]);
+    }
+  }
+}
+
+/* Removes the rows, moving everything after the first one only once */
+template <class T>
+void delete_vector_rows(wxVector<T> &data, size_t width,
+    const wxArrayInt &rows) {
+  if (rows.IsEmpty()) {
+    return;
+  }
+
+  size_t n_rows = data.size()/width;
+  size_t next = 0;
+  auto out = data.begin() + rows[0]*width;
+  for (size_t row = rows[0]; row < n_rows; row++) {
+    if (next < rows.GetCount() && (size_t) rows[next] == row) {
+      next++;
+      continue;
+    }
+    out = std::move(data.begin() + row*width, data.begin() + (row+1)*width,
+        out);
+  }
+  data.erase(out, data.end());
+}
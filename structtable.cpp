@@ -0,0 +1,229 @@
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+  #include <wx/wx.h>
+#endif
+#include <wx/grid.h>
+#include <wx/treectrl.h>
+#include <algorithm>
+#include <functional>
+#include <set>
+#include "structdata.h"
+#include "rowops.h"
+#include "structtable.h"
+
+const wxString StructTable::type_choices[3] = {
+  _("Wave"),
+  _("Noise"),
+  _("PCM"),
+};
+
+StructTable::StructTable() : data(nullptr) {
+  valid_attr = new wxGridCellAttr();
+  valid_attr->SetBackgroundColour(wxColour(0, 127, 0));
+  invalid_attr = new wxGridCellAttr();
+  invalid_attr->SetBackgroundColour(wxColor(127, 0, 0));
+
+  /* Type color is always green */
+  type_attr = valid_attr->Clone();
+  type_attr->SetEditor(new wxGridCellChoiceEditor(3, type_choices, false));
+
+  valid_patch_attr = valid_attr->Clone();
+  invalid_patch_attr = invalid_attr->Clone();
+  set_patch_names(std::set<wxString>());
+}
+
+StructTable::~StructTable() {
+  valid_attr->DecRef();
+  invalid_attr->DecRef();
+  type_attr->DecRef();
+  valid_patch_attr->DecRef();
+  invalid_patch_attr->DecRef();
+}
+
+void StructTable::set_data(StructData *d) {
+  int old_rows = GetNumberRows();
+  data = d;
+  int rows = GetNumberRows();
+
+  if (rows < old_rows) {
+    notify(wxGRIDTABLE_NOTIFY_ROWS_DELETED, rows, old_rows-rows);
+  }
+  else if (rows > old_rows) {
+    notify(wxGRIDTABLE_NOTIFY_ROWS_APPENDED, rows-old_rows, 0);
+  }
+}
+
+void StructTable::set_patch_names(const std::set<wxString> &names) {
+  /* A choice editor keeps the choices its control was created with, so a
+   * new one is shared by both patch cell attributes */
+  wxVector<wxString> choices(names.begin(), names.end());
+  auto editor = new wxGridCellChoiceEditor(choices.size(),
+      choices.empty()? nullptr : &choices[0], true);
+
+  editor->IncRef();
+  valid_patch_attr->SetEditor(editor);
+  invalid_patch_attr->SetEditor(editor);
+}
+
+wxArrayInt StructTable::move_rows(const wxArrayInt &rows, bool up) {
+  return move_vector_rows(data->data, 5, rows, up);
+}
+
+void StructTable::clone_rows(const wxArrayInt &rows) {
+  clone_vector_rows(data->data, 5, rows);
+  notify(wxGRIDTABLE_NOTIFY_ROWS_APPENDED, rows.GetCount(), 0);
+}
+
+void StructTable::delete_rows(const wxArrayInt &rows) {
+  delete_vector_rows(data->data, 5, rows);
+
+  /* Contiguous runs are reported from the bottom up */
+  for (int j = rows.GetCount()-1; j >= 0;) {
+    int i = j;
+    while (i > 0 && rows[i-1] == rows[i]-1) {
+      i--;
+    }
+    notify(wxGRIDTABLE_NOTIFY_ROWS_DELETED, rows[i], j-i+1);
+    j = i-1;
+  }
+}
+
+int StructTable::GetNumberRows() {
+  return data == nullptr? 0 : data->data.size()/5;
+}
+
+int StructTable::GetNumberCols() {
+  return 5;
+}
+
+wxString StructTable::GetValue(int row, int col) {
+  return data->data[row*5+col];
+}
+
+void StructTable::SetValue(int row, int col, const wxString &value) {
+  data->data[row*5+col] = value;
+}
+
+bool StructTable::InsertRows(size_t pos, size_t num) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  /* New rows are "Wave, NULL, NULL, 0, 0" */
+  auto &d = data->data;
+  size_t old_size = d.size();
+  d.resize(old_size + num*5);
+  std::move_backward(d.begin() + pos*5, d.begin() + old_size, d.end());
+  for (size_t i = pos*5; i < (pos+num)*5; i += 5) {
+    d[i] = type_choices[0];
+    d[i+1] = d[i+2] = wxT("NULL");
+    d[i+3] = d[i+4] = wxT("0");
+  }
+
+  notify(wxGRIDTABLE_NOTIFY_ROWS_INSERTED, pos, num);
+
+  return true;
+}
+
+bool StructTable::AppendRows(size_t num) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    data->data.push_back(type_choices[0]);
+    data->data.push_back(wxT("NULL"));
+    data->data.push_back(wxT("NULL"));
+    data->data.push_back(wxT("0"));
+    data->data.push_back(wxT("0"));
+  }
+
+  notify(wxGRIDTABLE_NOTIFY_ROWS_APPENDED, num, 0);
+
+  return true;
+}
+
+bool StructTable::DeleteRows(size_t pos, size_t num) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  auto &d = data->data;
+  d.erase(d.begin() + pos*5, d.begin() + (pos+num)*5);
+  notify(wxGRIDTABLE_NOTIFY_ROWS_DELETED, pos, num);
+
+  return true;
+}
+
+wxString StructTable::GetColLabelValue(int col) {
+  static const wxString labels[5] = {
+    _("Type"),
+    _("PCM Data"),
+    _("Patch"),
+    _("Loop Start"),
+    _("Loop End"),
+  };
+
+  return labels[col];
+}
+
+wxGridCellAttr *StructTable::GetAttr(int row, int col,
+    wxGridCellAttr::wxAttrKind kind) {
+  (void) kind;
+  wxGridCellAttr *attr;
+
+  if (col == 0) {
+    attr = type_attr;
+  }
+  else if (col == 2) {
+    attr = is_valid(row, col)? valid_patch_attr : invalid_patch_attr;
+  }
+  else {
+    attr = is_valid(row, col)? valid_attr : invalid_attr;
+  }
+
+  attr->IncRef();
+  return attr;
+}
+
+long StructTable::type_value(const wxString &label) {
+  for (long i = 0; i < 3; i++) {
+    if (label == type_choices[i]) {
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+bool StructTable::is_valid(int row, int col) {
+  if (data == nullptr || row >= GetNumberRows()) {
+    return true;
+  }
+
+  auto &value = data->data[row*5+col];
+  bool type_is_pcm = data->data[row*5] == _("PCM");
+
+  if (col == 1) {
+    return type_is_pcm? value != wxT("NULL") : value == wxT("NULL");
+  }
+  else if (col == 2) {
+    if (type_is_pcm) {
+      return value == wxT("NULL");
+    }
+    return value != wxT("NULL") && (!is_patch || is_patch(value));
+  }
+
+  /* 16 bit unsigned integers or whatever string */
+  long v = strtol(value.c_str(), NULL, 0);
+  return v >= 0 && v < 1<<16;
+}
+
+void StructTable::notify(int message, int pos, int num) {
+  if (GetView() == nullptr) {
+    return;
+  }
+
+  wxGridTableMessage msg(this, message, pos, num);
+  GetView()->ProcessTableMessage(msg);
+}
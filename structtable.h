@@ -0,0 +1,41 @@
+/* Grid model that reads and writes a StructData's rows in place */
+class StructTable : public wxGridTableBase {
+  public:
+    StructTable();
+    virtual ~StructTable();
+    void set_data(StructData *d);
+    StructData *get_data() const { return data; }
+    void set_patch_names(const std::set<wxString> &names);
+    wxArrayInt move_rows(const wxArrayInt &rows, bool up);
+    void clone_rows(const wxArrayInt &rows);
+    void delete_rows(const wxArrayInt &rows);
+
+    virtual int GetNumberRows();
+    virtual int GetNumberCols();
+    virtual wxString GetValue(int row, int col);
+    virtual void SetValue(int row, int col, const wxString &value);
+    virtual bool InsertRows(size_t pos=0, size_t num=1);
+    virtual bool AppendRows(size_t num=1);
+    virtual bool DeleteRows(size_t pos=0, size_t num=1);
+    virtual wxString GetColLabelValue(int col);
+    virtual wxGridCellAttr *GetAttr(int row, int col,
+        wxGridCellAttr::wxAttrKind kind);
+
+    static long type_value(const wxString &label);
+
+    /* Tells if a name belongs to an existing patch */
+    std::function<bool(const wxString &)> is_patch;
+
+    static const wxString type_choices[3];
+
+  private:
+    StructData *data;
+    wxGridCellAttr *valid_attr;
+    wxGridCellAttr *invalid_attr;
+    wxGridCellAttr *type_attr;
+    wxGridCellAttr *valid_patch_attr;
+    wxGridCellAttr *invalid_patch_attr;
+
+    bool is_valid(int row, int col);
+    void notify(int message, int pos, int num);
+};
@@ -0,0 +1,118 @@
+/* Names that can show up in patch data, resolved through a perfect hash that
+ * is built at compile time */
+struct Symbol {
+  std::string_view name;
+  long value;
+};
+
+constexpr Symbol symbols[] = {
+  {"WAVE_SINE", 0},
+  {"WAVE_SAWTOOTH", 1},
+  {"WAVE_TRIANGLE", 2},
+  {"WAVE_SQUARE_25", 3},
+  {"WAVE_SQUARE_50", 4},
+  {"WAVE_SQUARE_75", 5},
+  {"WAVE_FUZZY_SINE1", 6},
+  {"WAVE_FUZZY_SINE2", 7},
+  {"WAVE_FUZZY_SINE3", 8},
+  {"WAVE_FILTERED_SQUARE", 9},
+
+  {"WSIN", 0},
+  {"WSAW", 1},
+  {"WTRI", 2},
+  {"WS25", 3},
+  {"WS50", 4},
+  {"WS75", 5},
+  {"WFS1", 6},
+  {"WFS2", 7},
+  {"WFS3", 8},
+  {"WFSQ", 9},
+
+  {"PC_ENV_SPEED", 0},
+  {"PC_NOISE_PARAMS", 1},
+  {"PC_WAVE", 2},
+  {"PC_NOTE_UP", 3},
+  {"PC_NOTE_DOWN", 4},
+  {"PC_NOTE_CUT", 5},
+  {"PC_NOTE_HOLD", 6},
+  {"PC_ENV_VOL", 7},
+  {"PC_PITCH", 8},
+  {"PC_TREMOLO_LEVEL", 9},
+  {"PC_TREMOLO_RATE", 10},
+  {"PC_SLIDE", 11},
+  {"PC_SLIDE_SPEED", 12},
+  {"PC_LOOP_START", 13},
+  {"PC_LOOP_END", 14},
+  {"PATCH_END", 15},
+  /* Written for empty patches */
+  {"PC_PATCH_END", 15},
+};
+
+#define NUM_SYMBOLS (sizeof(symbols)/sizeof(Symbol))
+#define SYMBOL_SLOT_BITS 7
+
+/* FNV-1a, so it can be continued over a name split in two parts */
+constexpr uint32_t symbol_hash(std::string_view s,
+    uint32_t h=2166136261u) {
+  for (auto c : s) {
+    h ^= (uint8_t) c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+struct SymbolSlots {
+  /* Odd multiplier that spreads the hashes without collisions */
+  uint32_t multiplier;
+  /* Index into symbols plus one, zero for an empty slot */
+  uint8_t slots[1 << SYMBOL_SLOT_BITS];
+
+  constexpr size_t slot(uint32_t hash) const {
+    return (uint32_t) (hash * multiplier) >> (32 - SYMBOL_SLOT_BITS);
+  }
+};
+
+constexpr SymbolSlots make_symbol_slots() {
+  uint32_t hashes[NUM_SYMBOLS] = {};
+  for (size_t i = 0; i < NUM_SYMBOLS; i++)
+    hashes[i] = symbol_hash(symbols[i].name);
+
+  SymbolSlots s = {0x9e3779b1u, {}};
+  for (;;) {
+    bool collision = false;
+    for (auto &slot : s.slots)
+      slot = 0;
+    for (size_t i = 0; i < NUM_SYMBOLS && !collision; i++) {
+      auto &slot = s.slots[s.slot(hashes[i])];
+      collision = slot != 0;
+      slot = i+1;
+    }
+    if (!collision)
+      return s;
+    s.multiplier += 2;
+  }
+}
+
+constexpr SymbolSlots symbol_slots = make_symbol_slots();
+
+/* Looks up prefix followed by name, without joining them */
+inline bool find_symbol(std::string_view prefix, std::string_view name,
+    long &value) {
+  auto slot = symbol_slots.slots[
+    symbol_slots.slot(symbol_hash(name, symbol_hash(prefix)))];
+  if (!slot)
+    return false;
+
+  auto &symbol = symbols[slot-1];
+  if (symbol.name.size() != prefix.size() + name.size()
+      || symbol.name.compare(0, prefix.size(), prefix)
+      || symbol.name.compare(prefix.size(), name.size(), name))
+    return false;
+
+  value = symbol.value;
+  return true;
+}
+
+inline bool find_symbol(std::string_view name, long &value) {
+  return find_symbol(std::string_view(), name, value);
+}
@@ -0,0 +1,68 @@
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t threads) : running(0), stopping(false) {
+  if (!threads) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (size_t i = 0; i < threads; i++) {
+    workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  task_added.notify_all();
+
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  task_added.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  task_done.wait(lock, [this] { return tasks.empty() && !running; });
+}
+
+void ThreadPool::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;) {
+    task_added.wait(lock, [this] { return stopping || !tasks.empty(); });
+    if (tasks.empty()) {
+      /* Only reached when stopping */
+      return;
+    }
+
+    auto task = std::move(tasks.front());
+    tasks.pop_front();
+    running++;
+
+    lock.unlock();
+    task();
+    lock.lock();
+
+    running--;
+    if (tasks.empty() && !running) {
+      task_done.notify_all();
+    }
+  }
+}
@@ -0,0 +1,20 @@
+class ThreadPool {
+  public:
+    /* Zero threads means one per core */
+    ThreadPool(size_t threads=0);
+    ~ThreadPool();
+    void push(std::function<void()> task);
+    void wait();
+    size_t size() const { return workers.size(); }
+
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_added;
+    std::condition_variable task_done;
+    size_t running;
+    bool stopping;
+
+    void work();
+};
@@ -0,0 +1,118 @@
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include "filereader.h"
+#include "patchprogram.h"
+#include "patchdefs.h"
+#include "upscore.h"
+
+static_assert(UPS_SAMPLE_RATE == SAMPLE_RATE, "Sample rates differ");
+static_assert(UPS_INVALID_LOOP_COUNT
+    == (int) PatchProgram::INVALID_LOOP_COUNT, "Errors differ");
+
+struct ups_file {
+  std::vector<std::string> names;
+  std::vector<std::vector<int32_t>> commands;
+};
+
+struct ups_patch {
+  PatchProgram program;
+};
+
+/* Nothing thrown may leave through the C interface */
+ups_file *ups_file_load(const char *path) {
+  try {
+    std::multimap<std::string, std::vector<long>> patches;
+    std::multimap<std::string, std::vector<std::string>> structs;
+    if (!FileReader::read_patches_and_structs(path, patches, structs)) {
+      return nullptr;
+    }
+
+    std::unique_ptr<ups_file> file(new ups_file);
+    std::vector<long> commands;
+    for (auto &p : patches) {
+      file->names.push_back(p.first);
+      commands.resize((p.second.size()+2)/3*3);
+      if (!p.second.empty()) {
+        PatchProgram::read_values(p.second.data(), p.second.size(),
+            commands.data());
+      }
+
+      /* Saturated, like the reader does where a long is 32 bits */
+      auto &out = file->commands.emplace_back(commands.size());
+      for (size_t i = 0; i < commands.size(); i++) {
+        out[i] = std::clamp(commands[i], (long) INT32_MIN, (long) INT32_MAX);
+      }
+    }
+
+    return file.release();
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+
+void ups_file_free(ups_file *file) {
+  delete file;
+}
+
+size_t ups_file_patch_count(const ups_file *file) {
+  return file->names.size();
+}
+
+const char *ups_file_patch_name(const ups_file *file, size_t index) {
+  return file->names[index].c_str();
+}
+
+const int32_t *ups_file_patch_commands(const ups_file *file, size_t index,
+    size_t *size) {
+  *size = file->commands[index].size();
+  return file->commands[index].data();
+}
+
+ups_patch *ups_patch_compile(const int32_t *commands, size_t size) {
+  try {
+    std::vector<long> data(commands, commands + size);
+    std::unique_ptr<ups_patch> patch(new ups_patch);
+    patch->program.compile(data.data(), data.size());
+    return patch.release();
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+
+void ups_patch_free(ups_patch *patch) {
+  delete patch;
+}
+
+int ups_patch_error(const ups_patch *patch, size_t *command) {
+  if (command != nullptr) {
+    *command = patch->program.get_error_command();
+  }
+
+  return patch->program.get_error();
+}
+
+int ups_patch_is_noise(const ups_patch *patch) {
+  return patch->program.is_noise();
+}
+
+size_t ups_patch_length(const ups_patch *patch) {
+  return patch->program.get_length();
+}
+
+size_t ups_patch_render(const ups_patch *patch, uint8_t *out, size_t size) {
+  auto &program = patch->program;
+  if (program.get_error() != PatchProgram::NO_ERROR
+      || program.get_length() > size) {
+    return 0;
+  }
+
+  program.render(out);
+  return program.get_length();
+}
@@ -0,0 +1,69 @@
+/* C interface to the patch parser and renderer, for tools that only need
+ * the sound and not the editor. Unlike the editor's headers, this one
+ * includes what it needs, as it's meant to be used outside of it */
+#ifndef UPSCORE_H
+#define UPSCORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Samples are unsigned 8 bit and mono */
+#define UPS_SAMPLE_RATE 15734
+
+/* In the same order as PatchProgram::Error */
+enum {
+  UPS_NO_ERROR,
+  UPS_INVALID_DELAY,
+  UPS_INVALID_ENV_SPEED,
+  UPS_INVALID_NOISE_PARAMS,
+  UPS_INVALID_WAVE,
+  UPS_INVALID_NOTE_REACHED,
+  UPS_INVALID_ENV_VOL,
+  UPS_INVALID_NOTE,
+  UPS_INVALID_TREMOLO_LEVEL,
+  UPS_INVALID_TREMOLO_RATE,
+  UPS_INVALID_SLIDE_NOTE,
+  UPS_INVALID_SLIDE_SPEED,
+  UPS_ZERO_SLIDE_SPEED,
+  UPS_INVALID_LOOP_END,
+  UPS_NEGATIVE_LOOP_END,
+  UPS_INFINITE_LOOP_END,
+  UPS_NO_LOOP_START,
+  UPS_INVALID_LOOP_COUNT,
+};
+
+typedef struct ups_file ups_file;
+typedef struct ups_patch ups_patch;
+
+/* The patches declared in a source file, NULL if it can't be read. The
+ * path is UTF-8 on Windows */
+ups_file *ups_file_load(const char *path);
+void ups_file_free(ups_file *file);
+size_t ups_file_patch_count(const ups_file *file);
+/* As written in the file, owned by it */
+const char *ups_file_patch_name(const ups_file *file, size_t index);
+/* Delay, command and parameter of each command, owned by the file */
+const int32_t *ups_file_patch_commands(const ups_file *file, size_t index,
+    size_t *size);
+
+/* Only NULL if out of memory, otherwise check ups_patch_error */
+ups_patch *ups_patch_compile(const int32_t *commands, size_t size);
+void ups_patch_free(ups_patch *patch);
+/* One of the errors above, and the command it was found at */
+int ups_patch_error(const ups_patch *patch, size_t *command);
+int ups_patch_is_noise(const ups_patch *patch);
+/* In samples */
+size_t ups_patch_length(const ups_patch *patch);
+/* Writes every sample and returns how many, or 0 if they don't fit or the
+ * patch didn't compile */
+size_t ups_patch_render(const ups_patch *patch, uint8_t *out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,3 +27,22 @@ void UPSGrid::deselect_cells() {
     SelectRow(r, true);
   }
 }
+
+wxArrayInt UPSGrid::selected_rows() {
+  wxArrayInt rows = GetSelectedRows();
+  rows.Sort([] (int *a, int *b) { return (*a - *b); });
+  return rows;
+}
+
+void UPSGrid::select_rows(const wxArrayInt &rows) {
+  /* Whole runs at once, there may be many rows */
+  ClearSelection();
+  for (size_t i = 0; i < rows.GetCount();) {
+    size_t j = i;
+    while (j+1 < rows.GetCount() && rows[j+1] == rows[j]+1) {
+      j++;
+    }
+    SelectBlock(rows[i], 0, rows[j], GetNumberCols()-1, true);
+    i = j+1;
+  }
+}
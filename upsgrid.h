@@ -4,6 +4,8 @@ class UPSGrid : public wxGrid {
         const wxPoint &pos=wxDefaultPosition, const wxSize &size=wxDefaultSize,
         long style=wxWANTS_CHARS, const wxString &name=wxPanelNameStr);
     void deselect_cells();
+    wxArrayInt selected_rows();
+    void select_rows(const wxArrayInt &rows);
 
   private:
     void on_cell_left_click(wxGridEvent &event);
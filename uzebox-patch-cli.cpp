@@ -0,0 +1,168 @@
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#include "filereader.h"
+#include "threadpool.h"
+#include "patchprogram.h"
+#include "patchdefs.h"
+
+/* Checks or renders every patch in the given files without starting the
+ * editor, so it needs neither wxWidgets nor SDL. Exits with 1 if a file or
+ * a patch failed, and 2 if the arguments are wrong */
+
+struct FileData {
+  std::string path;
+  std::multimap<std::string, std::vector<long>> patches;
+  std::multimap<std::string, std::vector<std::string>> structs;
+  bool ok;
+};
+
+struct PatchJob {
+  const FileData *file;
+  std::string name;
+  std::vector<long> commands;
+  /* Where it's written, empty when only checking */
+  std::string out_path;
+  std::string error;
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+      "Usage: %s --check FILE...\n"
+      "       %s --render DIR FILE...\n"
+      "Checks every patch in the files, or renders each one to DIR/NAME.wav\n",
+      name, name);
+}
+
+static void run_job(PatchJob &job) {
+  if (!job.error.empty()) {
+    return;
+  }
+
+  PatchProgram program;
+  if (!program.compile(job.commands.data(), job.commands.size())) {
+    char error[128];
+    snprintf(error, sizeof(error), "Command %lu: %s",
+        (unsigned long) program.get_error_command()+1,
+        PatchProgram::error_message(program.get_error()));
+    job.error = error;
+    return;
+  }
+
+  if (job.out_path.empty()) {
+    return;
+  }
+
+  /* With the padding byte if needed */
+  size_t length = program.get_length();
+  std::vector<uint8_t> wave_data(WAVE_HEADER_LEN + length + (length & 1));
+  PatchProgram::write_wave_header(&wave_data[0], length);
+  program.render(&wave_data[WAVE_HEADER_LEN]);
+
+  FILE *file = fopen(job.out_path.c_str(), "wb");
+  if (file == nullptr) {
+    job.error = "Failed to write to " + job.out_path;
+    return;
+  }
+  bool written = fwrite(&wave_data[0], 1, wave_data.size(), file)
+    == wave_data.size();
+  if (fclose(file) || !written) {
+    job.error = "Failed to write to " + job.out_path;
+  }
+}
+
+int main(int argc, char **argv) {
+  int first;
+  std::string out_dir;
+  if (argc > 2 && !strcmp(argv[1], "--check")) {
+    first = 2;
+  }
+  else if (argc > 3 && !strcmp(argv[1], "--render")) {
+    out_dir = argv[2];
+    first = 3;
+  }
+  else {
+    usage(argv[0]);
+    return 2;
+  }
+
+  struct stat st;
+  if (!out_dir.empty()
+      && (stat(out_dir.c_str(), &st) || !S_ISDIR(st.st_mode))) {
+    fprintf(stderr, "%s: No such directory\n", argv[2]);
+    return 2;
+  }
+
+  std::vector<FileData> files(argc - first);
+  ThreadPool pool;
+  for (size_t i = 0; i < files.size(); i++) {
+    files[i].path = argv[first + i];
+    pool.push([&files, i] {
+      files[i].ok = FileReader::read_patches_and_structs(files[i].path,
+          files[i].patches, files[i].structs);
+    });
+  }
+  pool.wait();
+
+  /* Names are only unique within a file, but the output is all in one
+   * directory */
+  std::vector<PatchJob> jobs;
+  std::set<std::string> names;
+  size_t n_failed_files = 0;
+  for (auto &f : files) {
+    if (!f.ok) {
+      fprintf(stderr, "%s: Failed to read\n", f.path.c_str());
+      n_failed_files++;
+      continue;
+    }
+
+    for (auto &p : f.patches) {
+      PatchJob job{&f, p.first, std::vector<long>((p.second.size()+2)/3*3),
+        std::string(), std::string()};
+      if (!p.second.empty()) {
+        PatchProgram::read_values(p.second.data(), p.second.size(),
+            job.commands.data());
+      }
+      if (!out_dir.empty()) {
+        job.out_path = out_dir + "/" + p.first + ".wav";
+        if (!names.insert(p.first).second) {
+          job.error = "Another patch has the same name";
+        }
+      }
+      jobs.push_back(std::move(job));
+    }
+  }
+
+  for (size_t i = 0; i < jobs.size(); i++) {
+    pool.push([&jobs, i] { run_job(jobs[i]); });
+  }
+  pool.wait();
+
+  size_t n_failed = 0;
+  for (auto &job : jobs) {
+    if (!job.error.empty()) {
+      fprintf(stderr, "%s: %s: %s\n", job.file->path.c_str(),
+          job.name.c_str(), job.error.c_str());
+      n_failed++;
+    }
+  }
+
+  printf("%lu patches %s, %lu failed, %lu files couldn't be read\n",
+      (unsigned long) (jobs.size() - n_failed),
+      out_dir.empty()? "checked" : "rendered", (unsigned long) n_failed,
+      (unsigned long) n_failed_files);
+
+  return n_failed || n_failed_files? 1 : 0;
+}
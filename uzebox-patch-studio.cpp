@@ -11,20 +11,57 @@
 #include <wx/textfile.h>
 #include <wx/sound.h>
 #include <wx/ffile.h>
+#include <wx/dirdlg.h>
+#include <wx/dir.h>
+#include <wx/gauge.h>
+#include <wx/hashmap.h>
+#include <wx/timer.h>
+#include <wx/filename.h>
+#include <wx/progdlg.h>
 #include <algorithm>
 #include <map>
 #include <set>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
 #include <SDL.h>
 #include <SDL_mixer.h>
 #include <regex>
+#include <string>
+#include <string_view>
 #include "upsgrid.h"
 #include "filereader.h"
+#include "patchprogram.h"
+#include "patchdefs.h"
+#include "patchcache.h"
 #include "patchdata.h"
+#include "mixkernel.h"
+#include "patchplayer.h"
+#include "symbols.h"
+#include "threadpool.h"
+#include "renderqueue.h"
+#include "nameindex.h"
+#include "patchrefs.h"
 #include "structdata.h"
+#include "patchtable.h"
+#include "structtable.h"
 #include "icons.h"
 
 #define MIN_CLIENT_HEIGHT 400
 #define VERSION_STRING "0.0.2"
+#define LOAD_CHUNK_SIZE 256
+/* Bytes of rendered patches kept around for playing them again */
+#define RENDER_CACHE_LIMIT (64 << 20)
+/* Milliseconds without edits before the selected patch is rendered */
+#define PRERENDER_DELAY 300
 
 class UPSApp: public wxApp {
   public:
@@ -32,9 +69,16 @@ class UPSApp: public wxApp {
     virtual int OnExit();
 };
 
+/* Built by the loading thread, waiting to be added to the tree */
+struct LoadedData {
+  std::vector<std::pair<wxString, std::unique_ptr<StructData>>> structs;
+  std::vector<std::pair<wxString, std::unique_ptr<PatchData>>> patches;
+};
+
 class UPSFrame: public wxFrame {
   public:
     UPSFrame(const wxString &title, const wxPoint &pos, const wxSize &size);
+    ~UPSFrame();
     void open_file(const wxString &path, bool importing=false);
 
   private:
@@ -64,16 +108,36 @@ class UPSFrame: public wxFrame {
     void on_clone_data(wxCommandEvent &event);
     void on_sync(wxCommandEvent &event);
     void on_export(wxCommandEvent &event);
+    void on_export_all(wxCommandEvent &event);
     void on_help_shortcuts(wxCommandEvent &event);
     void on_help_noise(wxCommandEvent &event);
     void on_import(wxCommandEvent &event);
+    void on_import_directory(wxCommandEvent &event);
+    void on_cancel_load(wxCommandEvent &event);
+    void on_prerender(wxTimerEvent &event);
 
     bool validate_var_name(const wxString &name);
 
     wxString get_next_data_name(const wxString &base, bool try_bare=false);
-    wxTreeItemId find_data(const wxTreeItemId &item, const wxString &name);
+    void add_data(const std::multimap<wxString, wxVector<long>> &patches,
+        const std::multimap<wxString, wxVector<wxString>> &structs,
+        bool importing);
+    static bool read_file(const wxString &path,
+        std::multimap<wxString, wxVector<long>> &patches,
+        std::multimap<wxString, wxVector<wxString>> &structs);
+    static PatchData *make_patch_data(const wxVector<long> &vals);
+    static StructData *make_struct_data(const wxVector<wxString> &vals);
+    void load_file(const wxString path, unsigned long id);
+    void start_load(unsigned long id, size_t total);
+    void add_loaded_data(unsigned long id, std::shared_ptr<LoadedData> data);
+    void finish_load(unsigned long id, const wxString &path, bool ok);
+    void cancel_load();
+    void show_load_progress(bool show);
+    void move_commands(bool up);
+    void play_patch(const wxTreeItemId &item, bool loop);
+    void show_play_status(const wxTreeItemId &item, bool loop, bool ok);
     int add_patch_command(const wxString &delay="0",
-        const wxString &command=command_choices[0],
+        const wxString &command=PatchTable::command_choices[0],
         const wxString &param="0",
         int pos=-1);
     int add_struct_command(const wxString &type=_("Wave"),
@@ -82,19 +146,17 @@ class UPSFrame: public wxFrame {
         const wxString &loop_start="0",
         const wxString &loop_end="0",
         int pos=-1);
-    void update_patch_data(const wxTreeItemId &item);
     void read_patch_data(const wxTreeItemId &item);
-    void update_patch_row_colors(int row);
+    void show_patch_status(const wxTreeItemId &item);
     void save_to_file(const wxString &path);
     void clear();
-    void update_struct_row_colors(int row);
     void update_struct_data(const wxTreeItemId &item);
     void read_struct_data(const wxTreeItemId &item);
-    void replace_patch_in_structs(const wxString &src, const wxString &dst);
     void update_layout();
     void sanitize_string(wxString &str);
-    void replace_patch_in_struct(const wxTreeItemId &item,
-        const wxString &src, const wxString &dst);
+    bool is_patch(const wxString &name);
+    void update_struct_item_color(StructData *data);
+    void update_struct_item_colors(const wxString &patch);
 
     wxRegEx valid_var_name;
     wxTreeItemId data_tree_root;
@@ -103,16 +165,27 @@ class UPSFrame: public wxFrame {
     wxTreeCtrl *data_tree;
     UPSGrid *patch_grid;
     UPSGrid *struct_grid;
+    PatchTable *patch_table;
+    StructTable *struct_table;
     wxBoxSizer *top_sizer;
     wxBoxSizer *right_sizer;
     wxString current_file_path;
     std::set<wxString> patch_names = {wxT("NULL")};
-
-    static const std::map<wxString, std::pair<long, long>> limits;
-    static const wxString command_choices[16];
-    static const wxString type_choices[3];
-    static const std::map<wxString, long> choice_values;
-    static const std::map<wxString, long> command_ids;
+    NameIndex name_index;
+    PatchReferences patch_refs;
+    PatchCache render_cache;
+    RenderQueue render_queue;
+    wxTimer prerender_timer;
+    std::thread load_thread;
+    std::atomic<bool> load_cancelled;
+    unsigned long load_id;
+    bool load_importing;
+    wxString load_path;
+    std::unordered_set<StructData *> load_new_structs;
+    size_t load_total;
+    size_t load_done;
+    wxBoxSizer *load_sizer;
+    wxGauge *load_gauge;
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -137,9 +210,13 @@ enum {
   ID_DOWN_COMMAND,
   ID_CLONE_COMMAND,
   ID_EXPORT,
+  ID_EXPORT_ALL,
   ID_HELP_SHORTCUTS,
   ID_HELP_NOISE,
   ID_IMPORT,
+  ID_IMPORT_DIRECTORY,
+  ID_CANCEL_LOAD,
+  ID_PRERENDER,
 };
 
 wxBEGIN_EVENT_TABLE(UPSFrame, wxFrame)
@@ -169,9 +246,13 @@ wxBEGIN_EVENT_TABLE(UPSFrame, wxFrame)
   EVT_BUTTON(ID_REMOVE_DATA, UPSFrame::on_remove)
   EVT_BUTTON(ID_CLONE_DATA, UPSFrame::on_clone_data)
   EVT_MENU(ID_EXPORT, UPSFrame::on_export)
+  EVT_MENU(ID_EXPORT_ALL, UPSFrame::on_export_all)
   EVT_MENU(ID_HELP_SHORTCUTS, UPSFrame::on_help_shortcuts)
   EVT_MENU(ID_HELP_NOISE, UPSFrame::on_help_noise)
   EVT_MENU(ID_IMPORT, UPSFrame::on_import)
+  EVT_MENU(ID_IMPORT_DIRECTORY, UPSFrame::on_import_directory)
+  EVT_BUTTON(ID_CANCEL_LOAD, UPSFrame::on_cancel_load)
+  EVT_TIMER(ID_PRERENDER, UPSFrame::on_prerender)
 wxEND_EVENT_TABLE()
 wxIMPLEMENT_APP(UPSApp);
 
@@ -181,8 +262,10 @@ bool UPSApp::OnInit() {
   frame->SetIcon(uglyicon_xpm);
   frame->Show(true);
 
+  /* The mixer's chunks are only used if the player can't get a device */
   if (SDL_Init(SDL_INIT_AUDIO) == -1
-      || Mix_OpenAudio(SAMPLE_RATE, AUDIO_U8, 1, 4096) == -1) {
+      || (!PatchPlayer::get().open()
+        && Mix_OpenAudio(SAMPLE_RATE, AUDIO_U8, 1, 4096) == -1)) {
     wxMessageDialog(frame, SDL_GetError(),
         _("SDL Error"), wxOK | wxICON_ERROR).ShowModal();
     return false;
@@ -196,92 +279,34 @@ bool UPSApp::OnInit() {
 }
 
 int UPSApp::OnExit() {
+  PatchPlayer::get().close();
   Mix_CloseAudio();
   SDL_Quit();
 
   return 0;
 }
 
-const std::map<wxString, std::pair<long, long>> UPSFrame::limits = {
-  {_("ENV_SPEED"), std::make_pair(-128, 127)},
-  {_("NOISE_PARAMS"), std::make_pair(0, 255)},
-  {_("WAVE"), std::make_pair(0, NUM_WAVES-1)},
-  {_("NOTE_UP"), std::make_pair(0, 255)},
-  {_("NOTE_DOWN"), std::make_pair(0, 255)},
-  {_("NOTE_CUT"), std::make_pair(0, 0)},
-  {_("NOTE_HOLD"), std::make_pair(0, 0)},
-  {_("ENV_VOL"), std::make_pair(0, 255)},
-  {_("PITCH"), std::make_pair(0, 126)},
-  {_("TREMOLO_LEVEL"), std::make_pair(0, 255)},
-  {_("TREMOLO_RATE"), std::make_pair(0, 255)},
-  {_("SLIDE"), std::make_pair(-128, 127)},
-  {_("SLIDE_SPEED"), std::make_pair(0, 255)},
-  {_("LOOP_START"), std::make_pair(0, 255)},
-  {_("LOOP_END"), std::make_pair(0, 255)},
-  {_("PATCH_END"), std::make_pair(0, 0)},
-};
-
-const wxString UPSFrame::command_choices[16] = {
-  _("ENV_SPEED"),
-  _("NOISE_PARAMS"),
-  _("WAVE"),
-  _("NOTE_UP"),
-  _("NOTE_DOWN"),
-  _("NOTE_CUT"),
-  _("NOTE_HOLD"),
-  _("ENV_VOL"),
-  _("PITCH"),
-  _("TREMOLO_LEVEL"),
-  _("TREMOLO_RATE"),
-  _("SLIDE"),
-  _("SLIDE_SPEED"),
-  _("LOOP_START"),
-  _("LOOP_END"),
-  _("PATCH_END"),
-};
-
-const wxString UPSFrame::type_choices[3] = {
-  _("Wave"),
-  _("Noise"),
-  _("PCM"),
-};
-
-const std::map<wxString, long> UPSFrame::choice_values = {
-  {_("Wave"), 0},
-  {_("Noise"), 1},
-  {_("PCM"), 2},
-};
-
-const std::map<wxString, long> UPSFrame::command_ids = {
-  {_("ENV_SPEED"), PC_ENV_SPEED},
-  {_("NOISE_PARAMS"), PC_NOISE_PARAMS},
-  {_("WAVE"), PC_WAVE},
-  {_("NOTE_UP"), PC_NOTE_UP},
-  {_("NOTE_DOWN"), PC_NOTE_DOWN},
-  {_("NOTE_CUT"), PC_NOTE_CUT},
-  {_("NOTE_HOLD"), PC_NOTE_HOLD},
-  {_("ENV_VOL"), PC_ENV_VOL},
-  {_("PITCH"), PC_PITCH},
-  {_("TREMOLO_LEVEL"), PC_TREMOLO_LEVEL},
-  {_("TREMOLO_RATE"), PC_TREMOLO_RATE},
-  {_("SLIDE"), PC_SLIDE},
-  {_("SLIDE_SPEED"), PC_SLIDE_SPEED},
-  {_("LOOP_START"), PC_LOOP_START},
-  {_("LOOP_END"), PC_LOOP_END},
-  {_("PATCH_END"), PATCH_END},
-};
-
 UPSFrame::UPSFrame(const wxString &title, const wxPoint &pos,
     const wxSize &size) :
   wxFrame(NULL, wxID_ANY, title, pos, size),
-  valid_var_name("^[a-zA-Z\\_][a-zA-Z\\_0-9]*$") {
+  valid_var_name("^[a-zA-Z\\_][a-zA-Z\\_0-9]*$"),
+  render_cache(RENDER_CACHE_LIMIT),
+  render_queue(this),
+  prerender_timer(this, ID_PRERENDER),
+  load_cancelled(false),
+  load_id(0),
+  load_importing(false),
+  load_total(0),
+  load_done(0) {
   wxMenu *menuFile = new wxMenu;
   menuFile->Append(wxID_NEW);
   menuFile->Append(wxID_OPEN);
   menuFile->Append(wxID_SAVE);
   menuFile->Append(wxID_SAVEAS);
   menuFile->Append(ID_IMPORT, _("&Import file\tCTRL+SHIFT+I"));
+  menuFile->Append(ID_IMPORT_DIRECTORY, _("Import &directory"));
   menuFile->Append(ID_EXPORT, _("&Export to WAVE\tCTRL+SHIFT+E"));
+  menuFile->Append(ID_EXPORT_ALL, _("Export &all to WAVE"));
   menuFile->AppendSeparator();
   menuFile->Append(wxID_EXIT);
   wxMenu *menuHelp = new wxMenu;
@@ -336,8 +361,14 @@ UPSFrame::UPSFrame(const wxString &title, const wxPoint &pos,
   data_control_sizer->Add(data_control_sub_sizers[0], 0, wxEXPAND);
   data_control_sizer->Add(data_control_sub_sizers[1], 0, wxEXPAND);
 
+  load_sizer = new wxBoxSizer(wxHORIZONTAL);
+  load_gauge = new wxGauge(this, wxID_ANY, 1);
+  load_sizer->Add(load_gauge, wxEXPAND, wxALIGN_CENTER_VERTICAL);
+  load_sizer->Add(new wxButton(this, ID_CANCEL_LOAD, _("Cancel")));
+
   left_sizer->Add(data_control_sizer, 0, wxEXPAND);
   left_sizer->Add(data_tree, wxEXPAND, wxEXPAND);
+  left_sizer->Add(load_sizer, 0, wxEXPAND);
 
   command_control_sizer->Add(new wxBitmapButton(this, ID_NEW_COMMAND,
         wxArtProvider::GetBitmap(wxART_PLUS, wxART_BUTTON)));
@@ -350,10 +381,8 @@ UPSFrame::UPSFrame(const wxString &title, const wxPoint &pos,
   command_control_sizer->Add(new wxButton(this, ID_CLONE_COMMAND, _("Clone")));
 
   patch_grid = new UPSGrid(this, ID_PATCH_GRID);
-  patch_grid->CreateGrid(0, 3, wxGrid::wxGridSelectRows);
-  patch_grid->SetColLabelValue(0, _("Delay"));
-  patch_grid->SetColLabelValue(1, _("Command"));
-  patch_grid->SetColLabelValue(2, _("Parameter"));
+  patch_table = new PatchTable();
+  patch_grid->SetTable(patch_table, true, wxGrid::wxGridSelectRows);
   patch_grid->DisableDragColSize();
   patch_grid->AutoSize();
   patch_grid->SetColSize(1, patch_grid->GetColSize(1)*2);
@@ -361,12 +390,11 @@ UPSFrame::UPSFrame(const wxString &title, const wxPoint &pos,
   patch_grid->EnableDragColMove();
 
   struct_grid = new UPSGrid(this, ID_STRUCT_GRID);
-  struct_grid->CreateGrid(0, 5, wxGrid::wxGridSelectRows);
-  struct_grid->SetColLabelValue(0, _("Type"));
-  struct_grid->SetColLabelValue(1, _("PCM Data"));
-  struct_grid->SetColLabelValue(2, _("Patch"));
-  struct_grid->SetColLabelValue(3, _("Loop Start"));
-  struct_grid->SetColLabelValue(4, _("Loop End"));
+  struct_table = new StructTable();
+  struct_table->is_patch = [this] (const wxString &name) {
+    return is_patch(name);
+  };
+  struct_grid->SetTable(struct_table, true, wxGrid::wxGridSelectRows);
   struct_grid->DisableDragColSize();
   struct_grid->AutoSize();
   struct_grid->SetColSize(0, struct_grid->GetColSize(0)*2);
@@ -382,6 +410,7 @@ UPSFrame::UPSFrame(const wxString &title, const wxPoint &pos,
   top_sizer->Add(right_sizer, wxEXPAND, wxEXPAND);
 
   top_sizer->Hide(1);
+  top_sizer->Hide(load_sizer, true);
 
   SetSizer(top_sizer);
   update_layout();
@@ -405,6 +434,14 @@ UPSFrame::UPSFrame(const wxString &title, const wxPoint &pos,
         accelerator_entries));
 }
 
+UPSFrame::~UPSFrame() {
+  cancel_load();
+
+  /* The tables must not outlive the data they point to */
+  patch_table->set_data(nullptr);
+  struct_table->set_data(nullptr);
+}
+
 void UPSFrame::on_exit(wxCommandEvent &event) {
   (void) event;
   Close(true);
@@ -424,6 +461,7 @@ void UPSFrame::on_about(wxCommandEvent &event) {
 void UPSFrame::on_new(wxCommandEvent &event) {
   (void) event;
 
+  cancel_load();
   clear();
 }
 
@@ -440,10 +478,6 @@ void UPSFrame::on_data_tree_changed(wxTreeEvent &event) {
   patch_grid->EnableEditing(false);
   struct_grid->EnableEditing(false);
   if (old_item.IsOk()
-      && data_tree->GetItemParent(old_item) == data_tree_patches) {
-    update_patch_data(old_item);
-  }
-  else if (old_item.IsOk()
       && data_tree->GetItemParent(old_item) == data_tree_structs) {
     update_struct_data(old_item);
   }
@@ -452,6 +486,7 @@ void UPSFrame::on_data_tree_changed(wxTreeEvent &event) {
     auto parent = data_tree->GetItemParent(item);
     if (parent == data_tree_patches) {
       read_patch_data(item);
+      show_patch_status(item);
       top_sizer->Show(1, true);
       right_sizer->Show(1, true);
       right_sizer->Show(2, false);
@@ -477,6 +512,7 @@ void UPSFrame::on_new_patch(wxCommandEvent &event) {
   wxString name = get_next_data_name(wxT("patch"));
   wxTreeItemId c = data_tree->AppendItem(data_tree_patches, name);
   patch_names.insert(name);
+  name_index.add(name, c);
   data_tree->SetItemData(c, new PatchData());
   data_tree->SelectItem(c);
   data_tree->EditLabel(c);
@@ -486,6 +522,7 @@ void UPSFrame::on_new_struct(wxCommandEvent &event) {
   (void) event;
   wxString name = get_next_data_name(wxT("patchstruct"));
   wxTreeItemId c = data_tree->AppendItem(data_tree_structs, name);
+  name_index.add(name, c);
   data_tree->SetItemData(c, new StructData());
   data_tree->SelectItem(c);
   data_tree->EditLabel(c);
@@ -496,66 +533,38 @@ void UPSFrame::on_rename(wxCommandEvent &event) {
   data_tree->EditLabel(data_tree->GetSelection());
 }
 
-wxTreeItemId UPSFrame::find_data(const wxTreeItemId &root,
-    const wxString &name) {
-  wxTreeItemIdValue cookie;
-  auto item = data_tree->GetFirstChild(root, cookie);
-
-  while (item.IsOk()) {
-    if (data_tree->GetItemText(item) == name)
-      return item;
-
-    wxTreeItemId child = find_data(item, name);
-    if (child.IsOk())
-      return child;
-
-    item = data_tree->GetNextChild(root, cookie);
-  }
-
-  return wxTreeItemId();
-}
-
 wxString UPSFrame::get_next_data_name(const wxString &base, bool try_bare) {
-  wxTreeItemId item;
-  wxString next;
-
-  if (try_bare) {
-    item = find_data(data_tree_root, base);
-    if (!item.IsOk())
-      return base;
-  }
-
-  int i = 0;
-  do {
-    next = wxString::Format(wxT("%s%02d"), base, i++);
-    item = find_data(data_tree_root, next);
-  } while (item.IsOk());
-
-  return next;
+  return name_index.next_name(base, try_bare);
 }
 
 void UPSFrame::on_data_tree_label_edit_end(wxTreeEvent &event) {
   auto label = event.GetLabel();
 
-  if(!validate_var_name(label)) {
+  if (event.IsEditCancelled()) {
+    return;
+  }
+  else if(!validate_var_name(label)) {
     SetStatusText(_("Invalid variable name"));
     event.Veto();
     return;
   }
-  else if (find_data(data_tree_root, label).IsOk()) {
+  else if (name_index.find(label).IsOk()) {
     SetStatusText(_("Name already in use"));
     event.Veto();
     return;
   }
 
   auto item = event.GetItem();
-  if (data_tree->GetItemParent(item) == data_tree_patches) {
-    auto old_label = data_tree->GetItemText(item);
+  auto old_label = data_tree->GetItemText(item);
+  name_index.remove(old_label);
+  name_index.add(label, item);
 
+  if (data_tree->GetItemParent(item) == data_tree_patches) {
     patch_names.erase(old_label);
     patch_names.insert(label);
 
-    replace_patch_in_structs(old_label, label);
+    patch_refs.rename(old_label, label);
+    update_struct_item_colors(label);
   }
 }
 
@@ -574,13 +583,10 @@ int UPSFrame::add_patch_command(const wxString &delay, const wxString &command,
     row_num = pos;
     patch_grid->InsertRows(pos);
   }
-  patch_grid->SetCellEditor(row_num, 1, new wxGridCellChoiceEditor(16,
-        command_choices, false));
   patch_grid->SetCellValue(row_num, 0, delay);
   patch_grid->SetCellValue(row_num, 1, command);
   patch_grid->SetCellValue(row_num, 2, param);
 
-  update_patch_row_colors(row_num);
   patch_grid->deselect_cells();
 
   return row_num;
@@ -606,82 +612,63 @@ void UPSFrame::on_delete_command(wxCommandEvent &event) {
   }
 
   auto grid = right_sizer->IsShown(1)? patch_grid : struct_grid;
-  wxArrayInt selected = grid->GetSelectedRows();
-  selected.Sort([] (int *a, int *b) { return (*b - *a); });
-  for (auto row : selected)
-    grid->DeleteRows(row);
-}
-
-void UPSFrame::on_up_command(wxCommandEvent &event) {
-  (void) event;
-  if (!right_sizer->IsShown(1) && !right_sizer->IsShown(2)) {
-    return ;
+  wxArrayInt selected = grid->selected_rows();
+  if (selected.IsEmpty()) {
+    return;
   }
 
-  auto grid = right_sizer->IsShown(1)? patch_grid : struct_grid;
-  wxArrayInt selected = grid->GetSelectedRows();
-  selected.Sort([] (int *a, int *b) { return (*a - *b); });
-
   /* This forces the cell that is being edited to update its value */
   grid->EnableEditing(false);
   grid->EnableEditing(true);
 
-  wxArrayString v;
-  v.Add(wxEmptyString, grid->GetNumberCols());
-  for (int i = 0; i < (int) selected.GetCount(); i++) {
-    int row = selected[i];
-
-    for (size_t j = 0; j < v.GetCount(); j++) {
-      v[j] = grid->GetCellValue(row, j);
-    }
-
-    grid->DeleteRows(row);
-    row = std::max(i, row-1);
-    if (grid == patch_grid) {
-      add_patch_command(v[0], v[1], v[2], row);
-    }
-    else {
-      add_struct_command(v[0], v[1], v[2], v[3], v[4], row);
-    }
-    grid->SelectRow(row, true);
+  grid->BeginBatch();
+  if (grid == patch_grid) {
+    patch_table->delete_rows(selected);
+    show_patch_status(data_tree->GetSelection());
+  }
+  else {
+    struct_table->delete_rows(selected);
+    update_struct_data(data_tree->GetSelection());
   }
+  grid->ClearSelection();
+  grid->EndBatch();
 }
 
+void UPSFrame::on_up_command(wxCommandEvent &event) {
+  (void) event;
+  move_commands(true);
+}
 
 void UPSFrame::on_down_command(wxCommandEvent &event) {
   (void) event;
+  move_commands(false);
+}
+
+void UPSFrame::move_commands(bool up) {
   if (!right_sizer->IsShown(1) && !right_sizer->IsShown(2)) {
     return ;
   }
 
   auto grid = right_sizer->IsShown(1)? patch_grid : struct_grid;
-  wxArrayInt selected = grid->GetSelectedRows();
-  selected.Sort([] (int *a, int *b) { return (*b - *a); });
+  wxArrayInt selected = grid->selected_rows();
+  if (selected.IsEmpty()) {
+    return;
+  }
 
   /* This forces the cell that is being edited to update its value */
   grid->EnableEditing(false);
   grid->EnableEditing(true);
 
-  int last_row = grid->GetNumberRows()-1;
-  wxArrayString v;
-  v.Add(wxEmptyString, grid->GetNumberCols());
-  for (int i = 0; i < (int) selected.GetCount(); i++) {
-    int row = selected[i];
-
-    for (size_t j = 0; j < v.GetCount(); j++) {
-      v[j] = grid->GetCellValue(row, j);
-    }
-
-    grid->DeleteRows(row);
-    row = std::min(last_row-i, row+1);
-    if (grid == patch_grid) {
-      add_patch_command(v[0], v[1], v[2], row);
-    }
-    else {
-      add_struct_command(v[0], v[1], v[2], v[3], v[4], row);
-    }
-    grid->SelectRow(row, true);
+  grid->BeginBatch();
+  if (grid == patch_grid) {
+    grid->select_rows(patch_table->move_rows(selected, up));
+    show_patch_status(data_tree->GetSelection());
   }
+  else {
+    grid->select_rows(struct_table->move_rows(selected, up));
+    update_struct_data(data_tree->GetSelection());
+  }
+  grid->EndBatch();
 }
 
 void UPSFrame::on_clone_command(wxCommandEvent &event) {
@@ -691,95 +678,68 @@ void UPSFrame::on_clone_command(wxCommandEvent &event) {
   }
 
   auto grid = right_sizer->IsShown(1)? patch_grid : struct_grid;
-  wxArrayInt selected = grid->GetSelectedRows();
-  selected.Sort([] (int *a, int *b) { return (*a - *b); });
+  wxArrayInt selected = grid->selected_rows();
+  if (selected.IsEmpty()) {
+    return;
+  }
 
   /* This forces the cell that is being edited to update its value */
   grid->EnableEditing(false);
   grid->EnableEditing(true);
 
-  wxArrayString v;
-  v.Add(wxEmptyString, grid->GetNumberCols());
-  for (int i = 0; i < (int) selected.GetCount(); i++) {
-    int row = selected[i];
-
-    for (size_t j = 0; j < v.GetCount(); j++) {
-      v[j] = grid->GetCellValue(row, j);
-    }
-
-    if (grid == patch_grid) {
-      add_patch_command(v[0], v[1], v[2]);
-    }
-    else {
-      add_struct_command(v[0], v[1], v[2], v[3], v[4]);
-    }
+  grid->BeginBatch();
+  if (grid == patch_grid) {
+    patch_table->clone_rows(selected);
+    show_patch_status(data_tree->GetSelection());
   }
+  else {
+    struct_table->clone_rows(selected);
+    update_struct_data(data_tree->GetSelection());
+  }
+  grid->select_rows(selected);
+  grid->EndBatch();
 }
 
 void UPSFrame::on_cell_changed(wxGridEvent &event) {
   /* Patch grid is at position 1 */
   if (right_sizer->IsShown(1)) {
-    auto str = patch_grid->GetCellValue(event.GetRow(), event.GetCol());
-    sanitize_string(str);
-    patch_grid->SetCellValue(event.GetRow(), event.GetCol(), str);
-    update_patch_row_colors(event.GetRow());
+    /* Colors are taken from the data, but a command changes its row's */
+    patch_grid->ForceRefresh();
+    show_patch_status(data_tree->GetSelection());
   }
   else if (right_sizer->IsShown(2)) {
     auto str = struct_grid->GetCellValue(event.GetRow(), event.GetCol());
     sanitize_string(str);
     struct_grid->SetCellValue(event.GetRow(), event.GetCol(), str);
-    update_struct_row_colors(event.GetRow());
+    update_struct_data(data_tree->GetSelection());
+    struct_grid->ForceRefresh();
   }
 }
 
-void UPSFrame::update_patch_data(const wxTreeItemId &item) {
-  auto data = (PatchData *) data_tree->GetItemData(item);
-  data->data.clear();
-
-  for (int row = 0; row < patch_grid->GetNumberRows(); row++) {
-    long delay, command, param;
-    patch_grid->GetCellValue(row, 0).ToLong(&delay);
-    command = command_ids.find(patch_grid->GetCellValue(row, 1))->second;
-    patch_grid->GetCellValue(row, 2).ToLong(&param);
-
-    data->data.push_back(delay);
-    data->data.push_back(command);
-    data->data.push_back(param);
-  }
+void UPSFrame::read_patch_data(const wxTreeItemId &item) {
+  patch_table->set_data((PatchData *) data_tree->GetItemData(item));
+  patch_grid->ClearSelection();
+  patch_grid->ForceRefresh();
 }
 
-void UPSFrame::read_patch_data(const wxTreeItemId &item) {
+void UPSFrame::show_patch_status(const wxTreeItemId &item) {
   auto data = (PatchData *) data_tree->GetItemData(item);
-
-  if (patch_grid->GetNumberRows()) {
-    patch_grid->DeleteRows(0, patch_grid->GetNumberRows());
+  auto name = data_tree->GetItemText(item);
+  auto users = patch_refs.find(name);
+  double duration;
+
+  if (data->get_duration(duration)) {
+    SetStatusText(wxString::Format(
+          _("%s lasts %.2f seconds and is used by %lu structs"),
+          name, duration, users? users->size() : 0));
+    /* Waits for the edits to stop, restarting if there's another */
+    prerender_timer.StartOnce(PRERENDER_DELAY);
   }
-
-  for (size_t i = 0; i < data->data.size(); i += 3) {
-    add_patch_command(wxString::Format(wxT("%ld"), data->data[i]),
-        command_choices[std::min(15l, data->data[i+1])],
-        wxString::Format(wxT("%ld"), data->data[i+2]));
+  else {
+    SetStatusText(data->last_error);
   }
 }
 
-void UPSFrame::update_patch_row_colors(int row) {
-  long delay = strtol(patch_grid->GetCellValue(row, 0), NULL, 0);
-  long param = strtol(patch_grid->GetCellValue(row, 2), NULL, 0);
-
-  /* Delay color, always an unsigned integer */
-  patch_grid->SetCellBackgroundColour(row, 0,
-      delay < 0 || delay > 255? wxColor(127, 0, 0) : wxColour(0, 127, 0));
-
-  /* Command color is always green */
-  patch_grid->SetCellBackgroundColour(row, 1, wxColour(0, 127, 0));
-
-  /* Param limit depends on the command */
-  auto limit = limits.find(patch_grid->GetCellValue(row, 1));
-  patch_grid->SetCellBackgroundColour(row, 2,
-      param < limit->second.first || param > limit->second.second?
-      wxColor(127, 0, 0) : wxColour(0, 127, 0));
-}
-
 void UPSFrame::on_save(wxCommandEvent &event) {
   (void) event;
 
@@ -830,9 +790,6 @@ void UPSFrame::save_to_file(const wxString &path) {
   wxTreeItemIdValue cookie;
   auto item = data_tree->GetFirstChild(data_tree_patches, cookie);
   while (item.IsOk()) {
-    if (data_tree->IsSelected(item))
-      update_patch_data(item);
-
     file.AddLine(wxString::Format("const char %s[] PROGMEM = {",
           data_tree->GetItemText(item)));
 
@@ -853,7 +810,7 @@ void UPSFrame::save_to_file(const wxString &path) {
       }
       else {
         file.AddLine(wxString::Format("  %ld, PC_%s, %ld,",
-              data->data[i], command_choices[data->data[i+1]],
+              data->data[i], PatchTable::command_choices[data->data[i+1]],
               data->data[i+2]));
       }
     }
@@ -878,7 +835,7 @@ void UPSFrame::save_to_file(const wxString &path) {
     }
     for (size_t i = 0; i < data->data.size(); i += 5) {
       file.AddLine(wxString::Format("  {%ld, %s, %s, %s, %s},",
-            choice_values.find(data->data[i])->second, data->data[i+1],
+            StructTable::type_value(data->data[i]), data->data[i+1],
             data->data[i+2], data->data[i+3], data->data[i+4]));
       if (patch_defines.find(data->data[i+2].Upper()) == patch_defines.end()) {
         patch_defines.emplace(data->data[i+2].Upper(), i/5);
@@ -915,38 +872,193 @@ void UPSFrame::on_open(wxCommandEvent &event) {
 }
 
 void UPSFrame::open_file(const wxString &path, bool importing) {
+  cancel_load();
+
+  load_importing = importing;
+  load_path = path;
+  load_new_structs.clear();
+  load_total = load_done = 0;
+  load_cancelled = false;
+  load_thread = std::thread(&UPSFrame::load_file, this, path, ++load_id);
+
+  load_gauge->Pulse();
+  show_load_progress(true);
+  SetStatusText(wxString::Format(_("Loading %s"), path));
+}
+
+/* Runs on the loading thread. Parses the file and builds the data in chunks
+ * that the main thread adds to the tree as they arrive */
+void UPSFrame::load_file(const wxString path, unsigned long id) {
   std::multimap<wxString, wxVector<long>> patches;
   std::multimap<wxString, wxVector<wxString>> structs;
-  if (!FileReader::read_patches_and_structs(path, patches, structs)) {
-    SetStatusText(wxString::Format(_("Failed to open %s"), path));
+  if (!read_file(path, patches, structs)) {
+    CallAfter([this, id, path] { finish_load(id, path, false); });
     return;
   }
 
-  if (!importing) {
+  size_t total = patches.size() + structs.size();
+  CallAfter([this, id, total] { start_load(id, total); });
+
+  auto chunk = std::make_shared<LoadedData>();
+  auto flush = [&] () {
+    if (chunk->structs.empty() && chunk->patches.empty())
+      return;
+    CallAfter([this, id, chunk] { add_loaded_data(id, chunk); });
+    chunk = std::make_shared<LoadedData>();
+  };
+
+  /* Structs go first so renamed patches can be fixed in them */
+  for (auto &s : structs) {
+    if (load_cancelled)
+      return;
+    chunk->structs.emplace_back(s.first,
+        std::unique_ptr<StructData>(make_struct_data(s.second)));
+    if (chunk->structs.size() == LOAD_CHUNK_SIZE)
+      flush();
+  }
+  flush();
+
+  for (auto &p : patches) {
+    if (load_cancelled)
+      return;
+    chunk->patches.emplace_back(p.first,
+        std::unique_ptr<PatchData>(make_patch_data(p.second)));
+    if (chunk->patches.size() == LOAD_CHUNK_SIZE)
+      flush();
+  }
+  flush();
+
+  CallAfter([this, id, path] { finish_load(id, path, true); });
+}
+
+void UPSFrame::start_load(unsigned long id, size_t total) {
+  if (id != load_id)
+    return;
+
+  if (!load_importing) {
     /* Clean the data */
     clear();
   }
 
-  /* Add all the structs */
-  wxVector<wxTreeItemId> new_structs;
-  for (auto &s : structs) {
+  load_total = total;
+  load_gauge->SetRange(std::max((size_t) 1, total));
+  load_gauge->SetValue(0);
+}
+
+void UPSFrame::add_loaded_data(unsigned long id,
+    std::shared_ptr<LoadedData> data) {
+  if (id != load_id)
+    return;
+
+  data_tree->Freeze();
+
+  for (auto &s : data->structs) {
     wxString name = get_next_data_name(s.first, true);
     wxTreeItemId c = data_tree->AppendItem(data_tree_structs, name);
-    new_structs.push_back(c);
-
-    StructData *data = new StructData();
+    name_index.add(name, c);
+    auto struct_data = s.second.release();
+    data_tree->SetItemData(c, struct_data);
+    load_new_structs.insert(struct_data);
+    patch_refs.update(struct_data);
+  }
 
-    for (size_t i = 0; i < s.second.size(); i += 5) {
-      long type = strtol(s.second[i].c_str(), NULL, 0);
-      type = std::min(2l, std::max(0l, type));
-      data->data.push_back(type_choices[type]);
+  for (auto &p : data->patches) {
+    wxString name = get_next_data_name(p.first, true);
+    wxTreeItemId c = data_tree->AppendItem(data_tree_patches, name);
+    patch_names.insert(name);
+    name_index.add(name, c);
 
-      for (size_t j = 1; j < 5; j++) {
-        data->data.push_back(s.second[i+j]);
-      }
+    if (load_importing && p.first != name) {
+      patch_refs.rename(p.first, name, &load_new_structs);
     }
+    update_struct_item_colors(name);
+
+    data_tree->SetItemData(c, p.second.release());
+  }
+
+  data_tree->Expand(data_tree_structs);
+  data_tree->Expand(data_tree_patches);
+  data_tree->Thaw();
+
+  load_done += data->structs.size() + data->patches.size();
+  load_gauge->SetValue(load_done);
+  SetStatusText(wxString::Format(_("Loading %s: %lu of %lu"),
+        load_path, load_done, load_total));
+}
 
+void UPSFrame::finish_load(unsigned long id, const wxString &path, bool ok) {
+  if (id != load_id)
+    return;
+
+  load_thread.join();
+  show_load_progress(false);
+
+  /* Only now it's known which patches the new structs are missing */
+  for (auto s : load_new_structs) {
+    update_struct_item_color(s);
+  }
+  load_new_structs.clear();
+
+  if (!ok) {
+    SetStatusText(wxString::Format(_("Failed to open %s"), path));
+    return;
+  }
+
+  SetStatusText(wxString::Format(
+        _("%s opened with %lu patches and %lu structs"),
+        path, data_tree->GetChildrenCount(data_tree_patches, false),
+        data_tree->GetChildrenCount(data_tree_structs, false)));
+
+  if (!load_importing) {
+    current_file_path = path;
+    SetTitle(wxString::Format(_("Uzebox Patch Studio - %s"),
+          current_file_path));
+  }
+}
+
+void UPSFrame::cancel_load() {
+  if (!load_thread.joinable())
+    return;
+
+  load_cancelled = true;
+  load_thread.join();
+  /* Drops whatever the thread already queued */
+  load_id++;
+  show_load_progress(false);
+}
+
+void UPSFrame::on_cancel_load(wxCommandEvent &event) {
+  (void) event;
+
+  cancel_load();
+  SetStatusText(wxString::Format(_("Loading %s cancelled"), load_path));
+
+  /* Don't let a partially loaded file overwrite the original */
+  if (!load_importing) {
+    current_file_path.Clear();
+    SetTitle(_("Uzebox Patch Studio"));
+  }
+}
+
+void UPSFrame::show_load_progress(bool show) {
+  top_sizer->Show(load_sizer, show, true);
+  top_sizer->Layout();
+}
+
+void UPSFrame::add_data(
+    const std::multimap<wxString, wxVector<long>> &patches,
+    const std::multimap<wxString, wxVector<wxString>> &structs,
+    bool importing) {
+  /* Add all the structs */
+  std::unordered_set<StructData *> new_structs;
+  for (auto &s : structs) {
+    wxString name = get_next_data_name(s.first, true);
+    wxTreeItemId c = data_tree->AppendItem(data_tree_structs, name);
+    name_index.add(name, c);
+    auto data = make_struct_data(s.second);
     data_tree->SetItemData(c, data);
+    new_structs.insert(data);
+    patch_refs.update(data);
   }
 
   /* Add all the patches */
@@ -954,44 +1066,90 @@ void UPSFrame::open_file(const wxString &path, bool importing) {
     wxString name = get_next_data_name(p.first, true);
     wxTreeItemId c = data_tree->AppendItem(data_tree_patches, name);
     patch_names.insert(name);
+    name_index.add(name, c);
 
     if (importing && p.first != name) {
-      for (auto &s : new_structs) {
-        replace_patch_in_struct(s, p.first, name);
-      }
+      patch_refs.rename(p.first, name, &new_structs);
     }
+    update_struct_item_colors(name);
+
+    data_tree->SetItemData(c, make_patch_data(p.second));
+  }
 
-    PatchData *data = new PatchData();
+  for (auto s : new_structs) {
+    update_struct_item_color(s);
+  }
+}
+
+/* The reader has no wxWidgets in it, so what it finds is converted here.
+ * Safe on any thread */
+bool UPSFrame::read_file(const wxString &path,
+    std::multimap<wxString, wxVector<long>> &patches,
+    std::multimap<wxString, wxVector<wxString>> &structs) {
+#ifdef _WIN32
+  std::string fn(path.utf8_str());
+#else
+  std::string fn(path.fn_str());
+#endif
+  std::multimap<std::string, std::vector<long>> file_patches;
+  std::multimap<std::string, std::vector<std::string>> file_structs;
+  if (!FileReader::read_patches_and_structs(fn, file_patches, file_structs)) {
+    return false;
+  }
 
-    for (size_t i = 0; i < p.second.size(); i += 3) {
-      /* Delay */
-      data->data.push_back(p.second[i]);
-      /* Command */
-      data->data.push_back(std::min(15l, (long) p.second[i+1]));
-      /* Parameter. PATCH_END might not have one */
-      data->data.push_back(data->data.back() == 15 && i+2 >= p.second.size()?
-          0 : p.second[i+2]);
+  patches.clear();
+  for (auto &p : file_patches) {
+    wxVector<long> vals;
+    vals.reserve(p.second.size());
+    for (long v : p.second) {
+      vals.push_back(v);
     }
+    patches.emplace(wxString(p.first.data(), p.first.size()), vals);
+  }
 
-    data_tree->SetItemData(c, data);
+  structs.clear();
+  for (auto &s : file_structs) {
+    wxVector<wxString> vals;
+    vals.reserve(s.second.size());
+    for (auto &v : s.second) {
+      vals.push_back(wxString(v.data(), v.size()));
+    }
+    structs.emplace(wxString(s.first.data(), s.first.size()), vals);
   }
 
-  SetStatusText(wxString::Format(
-        _("%s opened with %lu patches and %lu structs"),
-        path, patches.size(), structs.size()));
+  return true;
+}
 
-  data_tree->ExpandAll();
+PatchData *UPSFrame::make_patch_data(const wxVector<long> &vals) {
+  return new PatchData(vals);
+}
 
-  if (!importing) {
-    current_file_path = path;
-    SetTitle(wxString::Format(_("Uzebox Patch Studio - %s"),
-          current_file_path));
+StructData *UPSFrame::make_struct_data(const wxVector<wxString> &vals) {
+  StructData *data = new StructData();
+
+  for (size_t i = 0; i < vals.size(); i += 5) {
+    long type = strtol(vals[i].c_str(), NULL, 0);
+    type = std::min(2l, std::max(0l, type));
+    data->data.push_back(StructTable::type_choices[type]);
+
+    for (size_t j = 1; j < 5; j++) {
+      data->data.push_back(vals[i+j]);
+    }
   }
+
+  return data;
 }
 
 void UPSFrame::clear() {
+  render_queue.cancel_all();
+  patch_table->set_data(nullptr);
+  struct_table->set_data(nullptr);
   data_tree->DeleteChildren(data_tree_patches);
   data_tree->DeleteChildren(data_tree_structs);
+  name_index.clear();
+  patch_refs.clear();
+  patch_names = {wxT("NULL")};
+  load_new_structs.clear();
 
   top_sizer->Hide(1);
   update_layout();
@@ -1002,19 +1160,7 @@ void UPSFrame::on_play(wxCommandEvent &event) {
 
   auto item = data_tree->GetSelection();
   if (item.IsOk() && data_tree->GetItemParent(item) == data_tree_patches) {
-    /* Force updates */
-    patch_grid->EnableEditing(false);
-    patch_grid->EnableEditing(true);
-    update_patch_data(item);
-
-    auto data = (PatchData *) data_tree->GetItemData(item);
-    if (data->play()) {
-      SetStatusText(wxString::Format(_("Playing %s"),
-            data_tree->GetItemText(item)));
-    }
-    else {
-      SetStatusText(data->last_error);
-    }
+    play_patch(item, false);
   }
 }
 
@@ -1023,22 +1169,90 @@ void UPSFrame::on_loop(wxCommandEvent &event) {
 
   auto item = data_tree->GetSelection();
   if (item.IsOk() && data_tree->GetItemParent(item) == data_tree_patches) {
-    /* Force updates */
-    patch_grid->EnableEditing(false);
-    patch_grid->EnableEditing(true);
-    update_patch_data(item);
+    play_patch(item, true);
+  }
+}
 
-    auto data = (PatchData *) data_tree->GetItemData(item);
-    if (data->play(true)) {
-      SetStatusText(wxString::Format(_("Looping %s"),
-            data_tree->GetItemText(item)));
-      data_tree->SetItemBold(item);
-    }
-    else {
-      SetStatusText(wxString::Format(_("Failed to loop %s"),
-            data_tree->GetItemText(item)));
+/* Streamed when the player has a device. Otherwise it's played once a
+ * worker has rendered it, right away if it's in the cache */
+void UPSFrame::play_patch(const wxTreeItemId &item, bool loop) {
+  /* Force updates */
+  patch_grid->EnableEditing(false);
+  patch_grid->EnableEditing(true);
+
+  auto data = (PatchData *) data_tree->GetItemData(item);
+  if (data->compile() == nullptr) {
+    show_play_status(item, loop, false);
+    return;
+  }
+
+  if (PatchPlayer::get().is_open()) {
+    show_play_status(item, loop, data->play(loop));
+    return;
+  }
+
+  auto cached = render_cache.find(data->data);
+  if (cached != nullptr) {
+    data->play_sound(cached, loop);
+    show_play_status(item, loop, true);
+    return;
+  }
+
+  SetStatusText(wxString::Format(_("Rendering %s"),
+        data_tree->GetItemText(item)));
+  render_queue.render(data, [this, item, data, loop] (
+        const PatchData &rendered, std::shared_ptr<PatchCache::Sound> sound) {
+    auto added = sound == nullptr? nullptr
+      : render_cache.add(rendered.data, sound);
+    if (added != nullptr) {
+      data->play_sound(added, loop);
     }
+    show_play_status(item, loop, added != nullptr);
+  });
+}
+
+void UPSFrame::show_play_status(const wxTreeItemId &item, bool loop,
+    bool ok) {
+  auto data = (PatchData *) data_tree->GetItemData(item);
+  if (!loop) {
+    SetStatusText(ok? wxString::Format(_("Playing %s"),
+          data_tree->GetItemText(item)) : data->last_error);
   }
+  else if (ok) {
+    SetStatusText(wxString::Format(_("Looping %s"),
+          data_tree->GetItemText(item)));
+    data_tree->SetItemBold(item);
+  }
+  else {
+    SetStatusText(wxString::Format(_("Failed to loop %s"),
+          data_tree->GetItemText(item)));
+  }
+}
+
+/* Renders the selected patch while the user isn't doing anything, so Play
+ * finds it in the cache, or joins the render if it isn't done yet. Only the
+ * mixer needs it, the player streams patches as they are */
+void UPSFrame::on_prerender(wxTimerEvent &event) {
+  (void) event;
+
+  auto item = data_tree->GetSelection();
+  if (PatchPlayer::get().is_open() || !item.IsOk()
+      || data_tree->GetItemParent(item) != data_tree_patches) {
+    return;
+  }
+
+  auto data = (PatchData *) data_tree->GetItemData(item);
+  if (data->compile() == nullptr || render_cache.find(data->data) != nullptr) {
+    return;
+  }
+
+  /* Replaces the one from before the last edit, if it's still queued */
+  render_queue.render(data, [this] (const PatchData &rendered,
+        std::shared_ptr<PatchCache::Sound> sound) {
+    if (sound != nullptr) {
+      render_cache.add(rendered.data, sound);
+    }
+  });
 }
 
 void UPSFrame::on_stop(wxCommandEvent &event) {
@@ -1047,6 +1261,7 @@ void UPSFrame::on_stop(wxCommandEvent &event) {
   auto item = data_tree->GetSelection();
   if (item.IsOk() && data_tree->GetItemParent(item) == data_tree_patches) {
     auto data = (PatchData *) data_tree->GetItemData(item);
+    render_queue.cancel(data);
     data->stop();
     data_tree->SetItemBold(item, false);
   }
@@ -1055,6 +1270,8 @@ void UPSFrame::on_stop(wxCommandEvent &event) {
 void UPSFrame::on_stop_all(wxCommandEvent &event) {
   (void) event;
 
+  render_queue.cancel_all();
+
   wxTreeItemIdValue cookie;
   auto item = data_tree->GetFirstChild(data_tree_patches, cookie);
   while (item.IsOk()) {
@@ -1065,6 +1282,7 @@ void UPSFrame::on_stop_all(wxCommandEvent &event) {
   }
 
   /* This causes non looping patches to stop */
+  PatchPlayer::get().stop_all();
   Mix_HaltChannel(-1);
 }
 
@@ -1081,12 +1299,6 @@ int UPSFrame::add_struct_command(const wxString &type, const wxString &pcm,
     struct_grid->InsertRows(pos);
   }
 
-  struct_grid->SetCellEditor(row_num, 0, new wxGridCellChoiceEditor(3,
-        type_choices, false));
-  struct_grid->SetCellEditor(row_num, 2, new wxGridCellChoiceEditor(
-        patch_names.size(),
-        &(wxVector<wxString>(patch_names.begin(), patch_names.end()))[0],
-        true));
   struct_grid->SetCellValue(row_num, 0, type);
   struct_grid->SetCellValue(row_num, 1, pcm);
   struct_grid->SetCellValue(row_num, 2, patch == wxEmptyString && patch_names.size()?
@@ -1094,82 +1306,23 @@ int UPSFrame::add_struct_command(const wxString &type, const wxString &pcm,
   struct_grid->SetCellValue(row_num, 3, loop_start);
   struct_grid->SetCellValue(row_num, 4, loop_end);
 
-  update_struct_row_colors(row_num);
   struct_grid->deselect_cells();
 
   return row_num;
 }
 
-void UPSFrame::update_struct_row_colors(int row) {
-  long loop_start = strtol(struct_grid->GetCellValue(row, 3), NULL, 0);
-  long loop_end = strtol(struct_grid->GetCellValue(row, 4), NULL, 0);
-
-  /* Type color is always green */
-  struct_grid->SetCellBackgroundColour(row, 0, wxColour(0, 127, 0));
-
-  auto pcm_data = struct_grid->GetCellValue(row, 1);
-  bool type_is_pcm = struct_grid->GetCellValue(row, 0) == _("PCM");
-  if (type_is_pcm) {
-    struct_grid->SetCellBackgroundColour(row, 1,
-        pcm_data == wxT("NULL")? wxColor(127, 0, 0) : wxColour(0, 127, 0));
-  }
-  else {
-    struct_grid->SetCellBackgroundColour(row, 1,
-        pcm_data != wxT("NULL")?  wxColor(127, 0, 0) : wxColour(0, 127, 0));
-  }
-
-  auto patch = struct_grid->GetCellValue(row, 2);
-  if (type_is_pcm) {
-    struct_grid->SetCellBackgroundColour(row, 2,
-        patch != wxT("NULL")? wxColor(127, 0, 0) : wxColour(0, 127, 0));
-  }
-  else {
-    struct_grid->SetCellBackgroundColour(row, 2,
-        patch == wxT("NULL") || patch_names.find(patch) == patch_names.end()?
-        wxColor(127, 0, 0) : wxColour(0, 127, 0));
-  }
-
-  /* 16 bit unsigned integers or whatever string */
-  struct_grid->SetCellBackgroundColour(row, 3,
-      loop_start < 0 || loop_start >= 1<<16?
-      wxColor(127, 0, 0) : wxColour(0, 127, 0));
-  struct_grid->SetCellBackgroundColour(row, 4,
-      loop_end < 0 || loop_end >= 1<<16?
-      wxColor(127, 0, 0) : wxColour(0, 127, 0));
-}
-
 void UPSFrame::update_struct_data(const wxTreeItemId &item) {
+  /* The grid edits the data in place, only what depends on it is left */
   auto data = (StructData *) data_tree->GetItemData(item);
-  data->data.clear();
-
-  for (int row = 0; row < struct_grid->GetNumberRows(); row++) {
-    for (int col = 0; col < 5; col++) {
-      data->data.push_back(struct_grid->GetCellValue(row, col));
-    }
-  }
+  patch_refs.update(data);
+  update_struct_item_color(data);
 }
 
 void UPSFrame::read_struct_data(const wxTreeItemId &item) {
-  auto data = (StructData *) data_tree->GetItemData(item);
-
-  if (struct_grid->GetNumberRows()) {
-    struct_grid->DeleteRows(0, struct_grid->GetNumberRows());
-  }
-
-  for (size_t i = 0; i < data->data.size(); i += 5) {
-    add_struct_command(data->data[i], data->data[i+1],
-        data->data[i+2], data->data[i+3], data->data[i+4]);
-  }
-}
-
-void UPSFrame::replace_patch_in_structs(const wxString &src,
-    const wxString &dst) {
-  wxTreeItemIdValue cookie;
-  auto item = data_tree->GetFirstChild(data_tree_structs, cookie);
-  while (item.IsOk()) {
-    replace_patch_in_struct(item, src, dst);
-    item = data_tree->GetNextChild(data_tree_structs, cookie);
-  }
+  struct_table->set_patch_names(patch_names);
+  struct_table->set_data((StructData *) data_tree->GetItemData(item));
+  struct_grid->ClearSelection();
+  struct_grid->ForceRefresh();
 }
 
 void UPSFrame::on_remove(wxCommandEvent &event) {
@@ -1181,8 +1334,38 @@ void UPSFrame::on_remove(wxCommandEvent &event) {
 
   auto parent = data_tree->GetItemParent(item);
 
-  if (parent != data_tree_root) {
+  if (parent == data_tree_root) {
+    return;
+  }
+
+  auto name = data_tree->GetItemText(item);
+  name_index.remove(name);
+
+  if (parent == data_tree_structs) {
+    auto data = (StructData *) data_tree->GetItemData(item);
+    load_new_structs.erase(data);
+    patch_refs.remove(data);
+    if (struct_table->get_data() == data) {
+      struct_table->set_data(nullptr);
+    }
+    data_tree->Delete(item);
+  }
+  else {
+    patch_names.erase(name);
+    auto data = (PatchData *) data_tree->GetItemData(item);
+    if (patch_table->get_data() == data) {
+      patch_table->set_data(nullptr);
+    }
+    render_queue.cancel(data);
     data_tree->Delete(item);
+
+    /* Structs still using it are left pointing to nothing */
+    auto users = patch_refs.find(name);
+    if (users != nullptr) {
+      update_struct_item_colors(name);
+      SetStatusText(wxString::Format(_("%s was used by %lu structs"),
+            name, users->size()));
+    }
   }
 }
 
@@ -1200,13 +1383,18 @@ void UPSFrame::on_clone_data(wxCommandEvent &event) {
 
   auto name = get_next_data_name(data_tree->GetItemText(item));
   auto c = data_tree->AppendItem(parent, name);
+  name_index.add(name, c);
   if (parent == data_tree_patches) {
     data_tree->SetItemData(c,
         new PatchData((PatchData *) data_tree->GetItemData(item)));
+    patch_names.insert(name);
+    update_struct_item_colors(name);
   }
   else if (parent == data_tree_structs) {
-    data_tree->SetItemData(c,
-        new StructData((StructData *) data_tree->GetItemData(item)));
+    auto data = new StructData((StructData *) data_tree->GetItemData(item));
+    data_tree->SetItemData(c, data);
+    patch_refs.update(data);
+    update_struct_item_color(data);
   }
 }
 
@@ -1253,20 +1441,125 @@ void UPSFrame::on_export(wxCommandEvent &event) {
     return;
   }
 
-  wxFFile file(file_dialog.GetPath(), "wb");
-  if (!file.IsOpened()) {
-    SetStatusText(wxString::Format(_("Failed to write to %s"),
-          file_dialog.GetPath()));
+  auto data = (PatchData *) data_tree->GetItemData(item);
+  if (data->compile() == nullptr) {
+    SetStatusText(data->last_error);
     return;
   }
 
-  wxVector<uint8_t> wave_data;
-  auto data = (PatchData *) data_tree->GetItemData(item);
-  if (!data->generate_wave(wave_data)) {
-    SetStatusText(data->last_error);
+  auto path = file_dialog.GetPath();
+  SetStatusText(wxString::Format(_("Exporting %s"), path));
+  render_queue.render(data, [this, path] (const PatchData &rendered,
+        std::shared_ptr<PatchCache::Sound> sound) {
+    if (sound == nullptr) {
+      SetStatusText(rendered.last_error);
+      return;
+    }
+
+    wxFFile file(path, "wb");
+    if (!file.IsOpened()) {
+      SetStatusText(wxString::Format(_("Failed to write to %s"), path));
+      return;
+    }
+    file.Write(&(sound->wave[0]), sound->wave.size());
+    SetStatusText(wxString::Format(_("Exported to %s"), path));
+  }, false);
+}
+
+void UPSFrame::on_export_all(wxCommandEvent &event) {
+  (void) event;
+
+  wxDirDialog dir_dialog(this, _("Export all to WAVE"), wxEmptyString,
+      wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+
+  if (dir_dialog.ShowModal() == wxID_CANCEL)
     return;
+
+  /* Copies, the workers can't share the patches with the main thread */
+  std::vector<PatchData *> sources;
+  std::vector<std::unique_ptr<PatchData>> patches;
+  std::vector<wxString> names;
+  wxTreeItemIdValue cookie;
+  auto item = data_tree->GetFirstChild(data_tree_patches, cookie);
+  while (item.IsOk()) {
+    sources.push_back((PatchData *) data_tree->GetItemData(item));
+    patches.emplace_back(new PatchData(sources.back()));
+    names.push_back(data_tree->GetItemText(item));
+    item = data_tree->GetNextChild(data_tree_patches, cookie);
+  }
+
+  size_t total = patches.size();
+  std::vector<wxString> paths(total), errors(total);
+  for (size_t i = 0; i < total; i++) {
+    paths[i] = wxFileName(dir_dialog.GetPath(), names[i], wxT("wav"))
+      .GetFullPath();
+  }
+
+  std::atomic<size_t> done(0);
+  std::atomic<bool> cancelled(false);
+  {
+    wxProgressDialog progress(_("Export all to WAVE"),
+        wxString::Format(_("Exporting %lu patches"), total),
+        std::max((size_t) 1, total), this,
+        wxPD_APP_MODAL | wxPD_AUTO_HIDE | wxPD_CAN_ABORT | wxPD_ELAPSED_TIME);
+
+    ThreadPool pool;
+    for (size_t i = 0; i < total; i++) {
+      pool.push([&, i] {
+        if (cancelled) {
+          return;
+        }
+
+        std::vector<uint8_t> wave_data;
+        if (!patches[i]->generate_wave(wave_data)) {
+          errors[i] = patches[i]->last_error;
+        }
+        else {
+          wxFFile file(paths[i], "wb");
+          if (!file.IsOpened()
+              || file.Write(&(wave_data[0]), wave_data.size())
+              != wave_data.size()) {
+            errors[i] = wxString::Format(_("Failed to write to %s"),
+                paths[i]);
+          }
+        }
+        done++;
+      });
+    }
+
+    /* Only the dialog handles events meanwhile */
+    while (done < total && !cancelled) {
+      if (!progress.Update(done)) {
+        cancelled = true;
+      }
+      wxMilliSleep(50);
+    }
+    pool.wait();
+  }
+
+  /* So the next render only goes over what gets edited */
+  for (size_t i = 0; i < total; i++) {
+    sources[i]->take_render(*patches[i]);
+  }
+
+  wxString failed;
+  size_t n_failed = 0;
+  for (size_t i = 0; i < total; i++) {
+    if (!errors[i].IsEmpty()) {
+      failed += wxString::Format(wxT("%s: %s\n"), names[i], errors[i]);
+      n_failed++;
+    }
+  }
+
+  SetStatusText(wxString::Format(
+        _("%lu patches exported to %s, %lu failed"),
+        done - n_failed, dir_dialog.GetPath(), n_failed));
+
+  if (n_failed) {
+    wxMessageDialog(this, failed,
+        wxString::Format(_("%lu patches failed to export"), n_failed),
+        wxOK | wxICON_WARNING).ShowModal();
   }
-  file.Write(&(wave_data[0]), wave_data.size());
 }
 
 void UPSFrame::on_help_shortcuts(wxCommandEvent &event) {
@@ -1308,12 +1601,84 @@ void UPSFrame::on_import(wxCommandEvent &event) {
   open_file(file_dialog.GetPath(), true);
 }
 
-void UPSFrame::replace_patch_in_struct(const wxTreeItemId &item,
-    const wxString &src, const wxString &dst) {
-  auto data = (StructData *) data_tree->GetItemData(item);
-  for (size_t i = 0; i < data->data.size(); i += 5) {
-    if (data->data[i+2] == src) {
-      data->data[i+2] = dst;
+void UPSFrame::on_import_directory(wxCommandEvent &event) {
+  (void) event;
+
+  wxDirDialog dir_dialog(this, _("Import directory"), wxEmptyString,
+      wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+
+  if (dir_dialog.ShowModal() == wxID_CANCEL)
+    return;
+
+  wxArrayString files;
+  wxDir::GetAllFiles(dir_dialog.GetPath(), &files, wxT("*.inc"));
+  files.Sort();
+
+  struct FileData {
+    std::multimap<wxString, wxVector<long>> patches;
+    std::multimap<wxString, wxVector<wxString>> structs;
+    bool ok;
+  };
+  std::vector<FileData> file_data(files.GetCount());
+
+  {
+    wxBusyCursor busy;
+    ThreadPool pool;
+    for (size_t i = 0; i < files.GetCount(); i++) {
+      pool.push([&file_data, &files, i] {
+        file_data[i].ok = read_file(files[i], file_data[i].patches,
+            file_data[i].structs);
+      });
+    }
+    pool.wait();
+  }
+
+  /* Merged in order, so renaming is the same as importing one by one */
+  size_t n_patches = 0, n_structs = 0, n_failed = 0;
+  data_tree->Freeze();
+  for (auto &f : file_data) {
+    if (!f.ok) {
+      n_failed++;
+      continue;
     }
+
+    add_data(f.patches, f.structs, true);
+    n_patches += f.patches.size();
+    n_structs += f.structs.size();
+  }
+  data_tree->ExpandAll();
+  data_tree->Thaw();
+
+  SetStatusText(wxString::Format(
+        _("%lu files imported with %lu patches and %lu structs, %lu failed"),
+        files.GetCount() - n_failed, n_patches, n_structs, n_failed));
+}
+
+bool UPSFrame::is_patch(const wxString &name) {
+  auto item = name_index.find(name);
+  return item.IsOk() && data_tree->GetItemParent(item) == data_tree_patches;
+}
+
+void UPSFrame::update_struct_item_color(StructData *data) {
+  bool dangling = false;
+  for (auto &patch : patch_refs.patches(data)) {
+    if (!is_patch(patch)) {
+      dangling = true;
+      break;
+    }
+  }
+
+  data_tree->SetItemTextColour(data->GetId(),
+      dangling? wxColour(127, 0, 0) : wxNullColour);
+}
+
+void UPSFrame::update_struct_item_colors(const wxString &patch) {
+  auto users = patch_refs.find(patch);
+  if (users == nullptr) {
+    return;
+  }
+
+  for (auto &user : *users) {
+    update_struct_item_color(user.first);
   }
 }
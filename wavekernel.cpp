@@ -0,0 +1,132 @@
+#include <cstddef>
+#include <cstdint>
+#include "wavekernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define WAVE_KERNEL_X86
+  #include <immintrin.h>
+#endif
+
+static void scale_scalar(uint8_t *table, const int8_t *wave, uint8_t vol) {
+  for (int k = 0; k < 256; k++) {
+    int16_t v16 = (int16_t) wave[k] * vol;
+    /* Signed extention */
+    int8_t v8 = v16 / 256;
+    table[k] = (int) v8 + 128;
+  }
+}
+
+static void lookup_scalar(uint8_t *out, const uint8_t *table, uint16_t phase,
+    uint16_t step, size_t n) {
+  for (size_t j = 0; j < n; j++) {
+    out[j] = table[phase >> 8];
+    phase += step;
+  }
+}
+
+#ifdef WAVE_KERNEL_X86
+/* Dividing by 256 rounds towards zero, so negatives get 255 added before
+ * the arithmetic shift */
+__attribute__((target("sse2")))
+static inline __m128i scale_sse2(__m128i s, __m128i vol) {
+  __m128i p = _mm_mullo_epi16(s, vol);
+  __m128i bias = _mm_and_si128(_mm_srai_epi16(p, 15), _mm_set1_epi16(0xff));
+  return _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(p, bias), 8),
+      _mm_set1_epi16(128));
+}
+
+__attribute__((target("sse2")))
+static void scale_sse2(uint8_t *table, const int8_t *wave, uint8_t vol) {
+  const __m128i v = _mm_set1_epi16(vol);
+
+  for (int k = 0; k < 256; k += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i *) (wave + k));
+    __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(s, s), 8);
+    __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(s, s), 8);
+    _mm_storeu_si128((__m128i *) (table + k),
+        _mm_packus_epi16(scale_sse2(lo, v), scale_sse2(hi, v)));
+  }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i scale_avx2(__m256i s, __m256i vol) {
+  __m256i p = _mm256_mullo_epi16(s, vol);
+  __m256i bias = _mm256_and_si256(_mm256_srai_epi16(p, 15),
+      _mm256_set1_epi16(0xff));
+  return _mm256_add_epi16(_mm256_srai_epi16(_mm256_add_epi16(p, bias), 8),
+      _mm256_set1_epi16(128));
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2(uint8_t *table, const int8_t *wave, uint8_t vol) {
+  const __m256i v = _mm256_set1_epi16(vol);
+
+  /* Unpacking and packing both work per 128 bit lane, so the order holds */
+  for (int k = 0; k < 256; k += 32) {
+    __m256i s = _mm256_loadu_si256((const __m256i *) (wave + k));
+    __m256i lo = _mm256_srai_epi16(_mm256_unpacklo_epi8(s, s), 8);
+    __m256i hi = _mm256_srai_epi16(_mm256_unpackhi_epi8(s, s), 8);
+    _mm256_storeu_si256((__m256i *) (table + k),
+        _mm256_packus_epi16(scale_avx2(lo, v), scale_avx2(hi, v)));
+  }
+}
+
+/* Table entries for the 8 phases, which are then moved 8 steps ahead.
+ * Phases are kept in 32 bit lanes, only bits 8 to 15 are ever used */
+__attribute__((target("avx2")))
+static inline __m256i gather_avx2(const uint8_t *table, __m256i &phases,
+    __m256i advance) {
+  const __m256i low_byte = _mm256_set1_epi32(0xff);
+  __m256i index = _mm256_and_si256(_mm256_srli_epi32(phases, 8), low_byte);
+  phases = _mm256_add_epi32(phases, advance);
+  return _mm256_and_si256(_mm256_i32gather_epi32((const int *) table, index,
+        1), low_byte);
+}
+
+__attribute__((target("avx2")))
+static void lookup_avx2(uint8_t *out, const uint8_t *table, uint16_t phase,
+    uint16_t step, size_t n) {
+  const __m256i offsets = _mm256_mullo_epi32(_mm256_set1_epi32(step),
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  const __m256i advance = _mm256_set1_epi32(step*8);
+  /* Packing interleaves the 128 bit lanes, this puts them back in order */
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  __m256i phases = _mm256_add_epi32(_mm256_set1_epi32(phase), offsets);
+
+  size_t j = 0;
+  for (; j+32 <= n; j += 32) {
+    __m256i a = gather_avx2(table, phases, advance);
+    __m256i b = gather_avx2(table, phases, advance);
+    __m256i c = gather_avx2(table, phases, advance);
+    __m256i d = gather_avx2(table, phases, advance);
+    __m256i ab = _mm256_packus_epi32(a, b), cd = _mm256_packus_epi32(c, d);
+    __m256i bytes = _mm256_packus_epi16(ab, cd);
+    _mm256_storeu_si256((__m256i *) (out + j),
+        _mm256_permutevar8x32_epi32(bytes, order));
+  }
+
+  lookup_scalar(out + j, table, phase + j*step, step, n - j);
+}
+#endif
+
+const WaveKernel &scalar_wave_kernel() {
+  static const WaveKernel kernel = {"scalar", scale_scalar, lookup_scalar};
+  return kernel;
+}
+
+const WaveKernel &wave_kernel() {
+  static const WaveKernel kernel = [] {
+#ifdef WAVE_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return WaveKernel{"avx2", scale_avx2, lookup_avx2};
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+      return WaveKernel{"sse2", scale_sse2, lookup_scalar};
+    }
+#endif
+    return scalar_wave_kernel();
+  }();
+
+  return kernel;
+}
@@ -0,0 +1,18 @@
+/* Wave frames are rendered in two steps: the wave is scaled by the frame's
+ * volume into a table of output samples, which is then read by phase. Both
+ * steps use the widest instructions the CPU supports */
+
+/* Tables are read 4 bytes at a time, so they have some padding */
+#define WAVE_TABLE_SIZE (256+4)
+
+struct WaveKernel {
+  const char *name;
+  /* table[k] = wave[k]*vol/256 + 128, as the player rounds it */
+  void (*scale)(uint8_t *table, const int8_t *wave, uint8_t vol);
+  /* out[j] = table[(phase + j*step) >> 8], with 16 bit phases */
+  void (*lookup)(uint8_t *out, const uint8_t *table, uint16_t phase,
+      uint16_t step, size_t n);
+};
+
+const WaveKernel &wave_kernel();
+const WaveKernel &scalar_wave_kernel();